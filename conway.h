@@ -1,14 +1,126 @@
+#pragma once
+#include "physical.h"
 #include "project.h"
 
-#define NUM_ROWS 16
-#define NUM_COLS 16
+// Life engines, pick one with CONWAY_ENGINE
+#define CONWAY_ENGINE_ARRAY     0   // one uint32_t per cell, per-cell neighbor scan
+#define CONWAY_ENGINE_BITBOARD  1   // one word per row, bit-sliced neighbor counts
+#define CONWAY_ENGINE_TILES     2   // one word per cell in the cell state layout, bit-sliced neighbor counts
 
-uint32_t conway_curr_frame[NUM_ROWS][NUM_COLS] = {0};  
-uint32_t conway_last_frame[NUM_ROWS][NUM_COLS] = {0};  
+#ifndef CONWAY_ENGINE
+#define CONWAY_ENGINE   CONWAY_ENGINE_TILES
+#endif
+
+/*
+Active region tracking. The grid is split into tiles of one cell each (tile n
+covers the fans of cell n). A tile can only change if it or one of the 8 tiles
+around it changed since it was last evaluated, so conway_update_frame only
+evaluates those. conway_dirty holds the tiles changed by the last generation
+plus any marked since (e.g. human input), the write path uses it to skip cells.
+*/
+typedef uint64_t conway_tiles_t;    // bit n = tile n
+
+conway_tiles_t conway_dirty = ALL_CELLS_MASK;   // everything is evaluated at first
+
+// Returns the bit of the tile holding (row,col)
+conway_tiles_t conway_tile_bit(uint32_t row, uint32_t col) {
+    return (conway_tiles_t) 1 << ((col / CELL_COLS) + GRID_CELL_COLS * (row / CELL_ROWS));
+}
+
+// Returns tiles plus the 8 tiles around each of them, handles wrap around
+conway_tiles_t conway_tiles_around(conway_tiles_t tiles) {
+    conway_tiles_t around = 0;
+    for (uint32_t tile = 0; tile < NUM_CELLS; tile++) {
+        if (!((tiles >> tile) & 1)) continue;
+        uint32_t tile_row = tile / GRID_CELL_COLS;
+        uint32_t tile_col = tile % GRID_CELL_COLS;
+        for (uint32_t dr = 0; dr < 3; dr++) {
+            for (uint32_t dc = 0; dc < 3; dc++) {
+                uint32_t row = (tile_row + GRID_CELL_ROWS + dr - 1) % GRID_CELL_ROWS;
+                uint32_t col = (tile_col + GRID_CELL_COLS + dc - 1) % GRID_CELL_COLS;
+                around |= (conway_tiles_t) 1 << (col + GRID_CELL_COLS * row);
+            }
+        }
+    }
+    return around;
+}
+
+/*
+Stepping a tile. Tiles use the cell state layout, bit n = fan n (row n /
+CELL_COLS). A tile is stepped at once with the same bit-sliced adders as the
+bitboard engine, the neighbor words are the tile shifted by a row or a
+column, with the row or column that falls off the edge taken from the tile
+next to it. The tiles engine steps the grid with it, distributed Life a cell's
+own tile.
+*/
+#define CONWAY_TILE_BITS    ((uint32_t) ((1ull << FANS_PER_CELL) - 1))
+#define CONWAY_TILE_COL0    ((uint32_t) (((1ull << FANS_PER_CELL) - 1) / ((1ull << CELL_COLS) - 1)))  // first column
+#define CONWAY_TILE_COLN    (CONWAY_TILE_COL0 << (CELL_COLS - 1))                           // last column
+#define CONWAY_TILE_ROWN    (((uint32_t) ((1ull << CELL_COLS) - 1)) << (FANS_PER_CELL - CELL_COLS))  // last row
+
+#define CONWAY_AROUND       9   // a tile and the tiles around it, [(dr + 1) * 3 + dc + 1], [4] = the tile
+
+// Returns every fan's left neighbor, the first column from the tile on the left
+uint32_t conway_tile_left(uint32_t mid, uint32_t left) {
+    return ((mid << 1) & ~CONWAY_TILE_COL0 & CONWAY_TILE_BITS) | ((left & CONWAY_TILE_COLN) >> (CELL_COLS - 1));
+}
+
+// Returns every fan's right neighbor, the last column from the tile on the right
+uint32_t conway_tile_right(uint32_t mid, uint32_t right) {
+    return ((mid >> 1) & ~CONWAY_TILE_COLN) | ((right & CONWAY_TILE_COL0) << (CELL_COLS - 1));
+}
+
+// Returns every fan's upper neighbor, the first row from the tile above
+uint32_t conway_tile_up(uint32_t mid, uint32_t up) {
+    return ((mid << CELL_COLS) & CONWAY_TILE_BITS) | (up >> (FANS_PER_CELL - CELL_COLS));
+}
+
+// Returns every fan's lower neighbor, the last row from the tile below
+uint32_t conway_tile_down(uint32_t mid, uint32_t down) {
+    return (mid >> CELL_COLS) | ((down << (FANS_PER_CELL - CELL_COLS)) & CONWAY_TILE_ROWN);
+}
+
+// Returns the generation after around[4], the tiles around it only need their edges
+uint32_t conway_step_tile(const uint32_t around[CONWAY_AROUND]) {
+    uint32_t mid = around[4];
+    uint32_t up = around[1], down = around[7], left = around[3], right = around[5];
+
+    // The rows above and below shifted left and right first, so the corners come from the diagonal tiles
+    uint32_t ml = conway_tile_left(mid, left), mr = conway_tile_right(mid, right);
+    uint32_t upl = conway_tile_left(up, around[0]);
+    uint32_t upr = conway_tile_right(up, around[2]);
+    uint32_t dnl = conway_tile_left(down, around[6]);
+    uint32_t dnr = conway_tile_right(down, around[8]);
+    uint32_t ul = conway_tile_up(ml, upl), u = conway_tile_up(mid, up), ur = conway_tile_up(mr, upr);
+    uint32_t dl = conway_tile_down(ml, dnl), d = conway_tile_down(mid, down), dr = conway_tile_down(mr, dnr);
+
+    // 2-bit neighbor sums of each row (the middle row doesn't count itself)
+    uint32_t u0 = ul ^ u ^ ur,   u1 = (ul & u) | (ur & (ul ^ u));
+    uint32_t m0 = ml ^ mr,       m1 = ml & mr;
+    uint32_t d0 = dl ^ d ^ dr,   d1 = (dl & d) | (dr & (dl ^ d));
+
+    // Add the three sums. Only bits 0-2 are kept, 8 neighbors wraps to 0 which is still "dead".
+    uint32_t s0 = u0 ^ m0 ^ d0;
+    uint32_t c0 = (u0 & m0) | (d0 & (u0 ^ m0));
+    uint32_t t  = u1 ^ m1;
+    uint32_t v  = d1 ^ c0;
+    uint32_t s1 = t ^ v;
+    uint32_t s2 = (u1 & m1) ^ (d1 & c0) ^ (t & v);
+
+    // Alive next if 3 neighbors, or 2 neighbors and already alive
+    return s1 & ~s2 & (s0 | mid);
+}
+
+#if (CONWAY_ENGINE == CONWAY_ENGINE_ARRAY)
+
+typedef uint32_t conway_frame_t[NUM_ROWS][NUM_COLS];
+
+conway_frame_t conway_curr_frame = {0};  
+conway_frame_t conway_last_frame = {0};  
 
 // Returns shift added to a row index and handles wrap around
 uint8_t addx(uint8_t index, int shift) {
-    if (index + shift > NUM_ROWS) {
+    if (index + shift >= NUM_ROWS) {
         return index + shift - NUM_ROWS;
     } else if (index + shift < 0) {
         return index + shift + NUM_ROWS;
@@ -20,7 +132,7 @@ uint8_t addx(uint8_t index, int shift) {
 
 // Returns shift added to a col index and handles wrap around
 uint8_t addy(uint8_t index, int shift) {
-    if (index + shift > NUM_COLS) {
+    if (index + shift >= NUM_COLS) {
         return index + shift - NUM_COLS;
     } else if (index + shift < 0) {
         return index + shift + NUM_COLS;
@@ -43,40 +155,47 @@ int get_neighbors(uint8_t row, uint8_t col) {
     return count;
 }
 
-// Updates the current frame based on Game of Life Rules
+// Updates the current frame based on Game of Life Rules, only in tiles that can change
 void conway_update_frame() {
+    conway_tiles_t active = conway_tiles_around(conway_dirty);
+
     // Count number of neighbors in current frame
     uint8_t neighbor_frame[NUM_ROWS][NUM_COLS] = {0};  
     for (int x = 0; x < NUM_ROWS; x++) {
         for (int y = 0; y < NUM_COLS; y++) {
-            neighbor_frame[x][y] = get_neighbors(x, y);
+            if (active & conway_tile_bit(x, y)) neighbor_frame[x][y] = get_neighbors(x, y);
         }
     }
     
     // Apply Game of Life Rules to next frame
+    conway_dirty = 0;
     for (int x = 0; x < NUM_ROWS; x++) {
         for (int y = 0; y < NUM_COLS; y++) {
+            if (!(active & conway_tile_bit(x, y))) continue;
+            uint32_t alive;
             if (conway_curr_frame[x][y]) {
                 // Handle Living Cell Rules
                 if (neighbor_frame[x][y] < 2 ||
                     neighbor_frame[x][y] > 3) {
-                    conway_curr_frame[x][y] = 0;  // Die if less than 2 or more than 3 living neighbors
+                    alive = 0;  // Die if less than 2 or more than 3 living neighbors
                 } else {
-                    conway_curr_frame[x][y] = 1;  // Stay alive if 2 or 3 living neighbors
+                    alive = 1;  // Stay alive if 2 or 3 living neighbors
                 }
             } else {
                 // Handle Dead Cell Rule
                 if (neighbor_frame[x][y] == 3) {
-                    conway_curr_frame[x][y] = 1;  // Come to life if 3 neighbors
+                    alive = 1;  // Come to life if 3 neighbors
                 } else {
-                    conway_curr_frame[x][y] = 0;  // Stay dead otherwise
+                    alive = 0;  // Stay dead otherwise
                 }
             }
+            if (alive != conway_curr_frame[x][y]) conway_dirty |= conway_tile_bit(x, y);
+            conway_curr_frame[x][y] = alive;
         }
     }
 }
 
-// returns 1 if curr frame doesn't match last
+// returns number of cells in curr frame that don't match last
 uint32_t conway_has_changed() {
     uint32_t num_changed = 0;
     for (int x = 0; x < NUM_ROWS; x++) {
@@ -87,84 +206,441 @@ uint32_t conway_has_changed() {
     return num_changed;
 }
 
-// Various conway stating states
-
-// All off
-uint32_t conway_dead[NUM_ROWS][NUM_COLS] = {
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
-};
-
-// Still lifes, no movement
-uint32_t conway_still_lifes[NUM_ROWS][NUM_COLS] = {
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,1,1,0,0,0,0,0,1,1,0,0,0,0,0,0},
-    {0,1,1,0,0,0,0,1,0,0,1,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,1,1,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,1,1,0,0,0,0,0,1,1,0,0,0,0},
-    {0,0,1,0,0,1,0,0,0,0,1,0,1,0,0,0},
-    {0,0,0,1,0,1,0,0,0,0,0,1,0,0,0,0},
-    {0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,1,0,1,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
-};
-
-// oscillators with a period of 2
-uint32_t conway_osc[NUM_ROWS][NUM_COLS] = {
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,1,1,1,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,1,1,1,0,0},
-    {0,0,0,0,0,0,0,0,0,0,1,1,1,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,1,1,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,1,1,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,1,1,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,1,1,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
-};
-
-// pulsar with period of 3
-uint32_t conway_pulsar[NUM_ROWS][NUM_COLS] = {
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,1,1,1,0,0,0,1,1,1,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,1,0,0,0,0,1,0,1,0,0,0,0,1,0,0},
-    {0,1,0,0,0,0,1,0,1,0,0,0,0,1,0,0},
-    {0,1,0,0,0,0,1,0,1,0,0,0,0,1,0,0},
-    {0,0,0,1,1,1,0,0,0,1,1,1,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,1,1,1,0,0,0,1,1,1,0,0,0,0},
-    {0,1,0,0,0,0,1,0,1,0,0,0,0,1,0,0},
-    {0,1,0,0,0,0,1,0,1,0,0,0,0,1,0,0},
-    {0,1,0,0,0,0,1,0,1,0,0,0,0,1,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,1,1,1,0,0,0,1,1,1,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
-    {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}
-};
+// Returns 1 if (row,col) of frame is alive
+uint32_t conway_get(conway_frame_t frame, uint32_t row, uint32_t col) {
+    return frame[row][col] ? 1 : 0;
+}
+
+// Sets (row,col) of frame alive (1) or dead (0)
+void conway_set(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t alive) {
+    frame[row][col] = alive ? 1 : 0;
+}
+
+// Returns `n` (max 32) cells of a row starting at col, bit 0 = col
+uint32_t conway_get_bits(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t n) {
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (frame[row][col + i]) bits |= (1u << i);
+    }
+    return bits;
+}
+
+// Sets `n` (max 32) cells of a row starting at col, bit 0 = col
+void conway_set_bits(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t n, uint32_t bits) {
+    for (uint32_t i = 0; i < n; i++) {
+        frame[row][col + i] = (bits >> i) & 1;
+    }
+}
+
+#elif (CONWAY_ENGINE == CONWAY_ENGINE_BITBOARD)
+
+/*
+Each row of the grid is packed into a single word, bit n = column n.
+Neighbor counts for a whole row are built at once with bit-sliced adders:
+every bit position is an independent counter, so one row costs a handful
+of logic ops instead of 8 lookups per cell. Wrap around is a rotate.
+The word is the smallest that holds a row, bits above NUM_COLS stay 0.
+*/
+#if (NUM_COLS <= 16)
+typedef uint16_t conway_row_t;
+#define CONWAY_POPCOUNT(r)  __builtin_popcount(r)
+#elif (NUM_COLS <= 32)
+typedef uint32_t conway_row_t;
+#define CONWAY_POPCOUNT(r)  __builtin_popcountl(r)
+#else
+typedef uint64_t conway_row_t;
+#define CONWAY_POPCOUNT(r)  __builtin_popcountll(r)
+#endif
+typedef conway_row_t conway_frame_t[NUM_ROWS];
+
+#define CONWAY_ROW_MASK ((conway_row_t) (((conway_row_t) 2 << (NUM_COLS - 1)) - 1))
+#define CONWAY_ROTL(r)  ((conway_row_t) ((((r) << 1) | ((r) >> (NUM_COLS - 1))) & CONWAY_ROW_MASK))
+#define CONWAY_ROTR(r)  ((conway_row_t) ((((r) >> 1) | ((r) << (NUM_COLS - 1))) & CONWAY_ROW_MASK))
+
+conway_frame_t conway_curr_frame = {0};
+conway_frame_t conway_last_frame = {0};
+
+// Returns the next state of row `mid` given the rows above and below it
+conway_row_t conway_next_row(conway_row_t up, conway_row_t mid, conway_row_t down) {
+    conway_row_t ul = CONWAY_ROTL(up),  ur = CONWAY_ROTR(up);
+    conway_row_t ml = CONWAY_ROTL(mid), mr = CONWAY_ROTR(mid);
+    conway_row_t dl = CONWAY_ROTL(down), dr = CONWAY_ROTR(down);
+
+    // 2-bit neighbor sums of each row (the middle row doesn't count itself)
+    conway_row_t u0 = ul ^ up ^ ur,   u1 = (ul & up) | (ur & (ul ^ up));
+    conway_row_t m0 = ml ^ mr,        m1 = ml & mr;
+    conway_row_t d0 = dl ^ down ^ dr, d1 = (dl & down) | (dr & (dl ^ down));
+
+    // Add the three sums. Only bits 0-2 are kept, 8 neighbors wraps to 0 which is still "dead".
+    conway_row_t s0 = u0 ^ m0 ^ d0;
+    conway_row_t c0 = (u0 & m0) | (d0 & (u0 ^ m0));
+    conway_row_t t  = u1 ^ m1;
+    conway_row_t v  = d1 ^ c0;
+    conway_row_t s1 = t ^ v;
+    conway_row_t s2 = (u1 & m1) ^ (d1 & c0) ^ (t & v);
+
+    // Alive next if 3 neighbors, or 2 neighbors and already alive
+    return s1 & ~s2 & (s0 | mid);
+}
+
+// Computes the generation after `curr` into `next`
+void conway_step(conway_frame_t next, conway_frame_t curr) {
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        conway_row_t up   = curr[(row + NUM_ROWS - 1) % NUM_ROWS];
+        conway_row_t down = curr[(row + 1) % NUM_ROWS];
+        next[row] = conway_next_row(up, curr[row], down);
+    }
+}
+
+#define CONWAY_TILE_MASK    ((conway_row_t) ((1ull << CELL_COLS) - 1))   // bits of one tile in a row
+
+// Returns the bits of a row covered by the tiles of tile row `tile_row`
+conway_row_t conway_tiles_row_mask(conway_tiles_t tiles, uint32_t tile_row) {
+    conway_row_t mask = 0;
+    for (uint32_t tile_col = 0; tile_col < GRID_CELL_COLS; tile_col++) {
+        if ((tiles >> (tile_col + GRID_CELL_COLS * tile_row)) & 1) mask |= CONWAY_TILE_MASK << (tile_col * CELL_COLS);
+    }
+    return mask;
+}
+
+// Returns the tiles of tile row `tile_row` holding any bit of a row
+conway_tiles_t conway_row_tiles(conway_row_t bits, uint32_t tile_row) {
+    conway_tiles_t tiles = 0;
+    for (uint32_t tile_col = 0; tile_col < GRID_CELL_COLS; tile_col++) {
+        if ((bits >> (tile_col * CELL_COLS)) & CONWAY_TILE_MASK) tiles |= (conway_tiles_t) 1 << (tile_col + GRID_CELL_COLS * tile_row);
+    }
+    return tiles;
+}
+
+// Updates the current frame based on Game of Life Rules, only in tiles that can change
+void conway_update_frame() {
+    conway_tiles_t active = conway_tiles_around(conway_dirty);
+    conway_frame_t next;
+    conway_dirty = 0;
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        conway_row_t curr = conway_curr_frame[row];
+        conway_row_t mask = conway_tiles_row_mask(active, row / CELL_ROWS);
+        if (mask == 0) {
+            next[row] = curr;
+            continue;
+        }
+        conway_row_t up   = conway_curr_frame[(row + NUM_ROWS - 1) % NUM_ROWS];
+        conway_row_t down = conway_curr_frame[(row + 1) % NUM_ROWS];
+        next[row] = (conway_next_row(up, curr, down) & mask) | (curr & ~mask);
+        conway_dirty |= conway_row_tiles(next[row] ^ curr, row / CELL_ROWS);
+    }
+    memcpy(conway_curr_frame, next, sizeof(next));
+}
+
+// returns number of cells in curr frame that don't match last
+uint32_t conway_has_changed() {
+    uint32_t num_changed = 0;
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        num_changed += CONWAY_POPCOUNT(conway_curr_frame[row] ^ conway_last_frame[row]);
+    }
+    return num_changed;
+}
+
+// Returns 1 if (row,col) of frame is alive
+uint32_t conway_get(conway_frame_t frame, uint32_t row, uint32_t col) {
+    return (frame[row] >> col) & 1;
+}
+
+// Sets (row,col) of frame alive (1) or dead (0)
+void conway_set(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t alive) {
+    if (alive) frame[row] |= (conway_row_t) ((conway_row_t) 1 << col);
+    else frame[row] &= (conway_row_t) ~((conway_row_t) 1 << col);
+}
+
+// Returns `n` (max 32) cells of a row starting at col, bit 0 = col
+uint32_t conway_get_bits(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t n) {
+    return (uint32_t) (frame[row] >> col) & (uint32_t) (((uint64_t) 1 << n) - 1);
+}
+
+// Sets `n` (max 32) cells of a row starting at col, bit 0 = col
+void conway_set_bits(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t n, uint32_t bits) {
+    conway_row_t mask = (conway_row_t) ((((uint64_t) 1 << n) - 1) << col);
+    frame[row] = (conway_row_t) ((frame[row] & ~mask) | (((conway_row_t) bits << col) & mask));
+}
+
+#elif (CONWAY_ENGINE == CONWAY_ENGINE_TILES)
+
+/*
+The grid is stored the way the cells see it: one word per tile in the cell
+state layout, so reading and writing cells are word copies. Every tile is
+stepped with conway_step_tile, wrap around comes from the tile order.
+*/
+typedef uint32_t conway_frame_t[NUM_CELLS];
+
+conway_frame_t conway_curr_frame = {0};
+conway_frame_t conway_last_frame = {0};
+
+// Returns the tile dr tile rows and dc tile columns away from tile, handles wrap around
+uint32_t conway_tile_at(uint32_t tile, int dr, int dc) {
+    uint32_t row = (tile / GRID_CELL_COLS + GRID_CELL_ROWS + dr) % GRID_CELL_ROWS;
+    uint32_t col = (tile % GRID_CELL_COLS + GRID_CELL_COLS + dc) % GRID_CELL_COLS;
+    return col + GRID_CELL_COLS * row;
+}
+
+// Returns the next state of a tile of frame
+uint32_t conway_next_tile(conway_frame_t frame, uint32_t tile) {
+    uint32_t around[CONWAY_AROUND];
+    for (int dr = -1; dr < 2; dr++) {
+        for (int dc = -1; dc < 2; dc++) around[(dr + 1) * 3 + dc + 1] = frame[conway_tile_at(tile, dr, dc)];
+    }
+    return conway_step_tile(around);
+}
+
+// Computes the generation after `curr` into `next`
+void conway_step(conway_frame_t next, conway_frame_t curr) {
+    for (uint32_t tile = 0; tile < NUM_CELLS; tile++) next[tile] = conway_next_tile(curr, tile);
+}
+
+// Updates the current frame based on Game of Life Rules, only in tiles that can change
+void conway_update_frame() {
+    conway_tiles_t active = conway_tiles_around(conway_dirty);
+    conway_frame_t next;
+    memcpy(next, conway_curr_frame, sizeof(next));
+    conway_dirty = 0;
+    while (active) {
+        uint32_t tile = __builtin_ctzll(active);
+        active &= active - 1;
+        next[tile] = conway_next_tile(conway_curr_frame, tile);
+        if (next[tile] != conway_curr_frame[tile]) conway_dirty |= (conway_tiles_t) 1 << tile;
+    }
+    memcpy(conway_curr_frame, next, sizeof(next));
+}
+
+// returns number of cells in curr frame that don't match last
+uint32_t conway_has_changed() {
+    uint32_t num_changed = 0;
+    for (uint32_t tile = 0; tile < NUM_CELLS; tile++) {
+        num_changed += __builtin_popcount(conway_curr_frame[tile] ^ conway_last_frame[tile]);
+    }
+    return num_changed;
+}
+
+// Returns 1 if (row,col) of frame is alive
+uint32_t conway_get(conway_frame_t frame, uint32_t row, uint32_t col) {
+    uint32_t tile = col / CELL_COLS + GRID_CELL_COLS * (row / CELL_ROWS);
+    return (frame[tile] >> ((row % CELL_ROWS) * CELL_COLS + col % CELL_COLS)) & 1;
+}
+
+// Sets (row,col) of frame alive (1) or dead (0)
+void conway_set(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t alive) {
+    uint32_t tile = col / CELL_COLS + GRID_CELL_COLS * (row / CELL_ROWS);
+    uint32_t bit = 1u << ((row % CELL_ROWS) * CELL_COLS + col % CELL_COLS);
+    if (alive) frame[tile] |= bit;
+    else frame[tile] &= ~bit;
+}
+
+// Returns `n` (max 32) cells of a row starting at col, bit 0 = col. Goes a tile at a time.
+uint32_t conway_get_bits(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t n) {
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < n;) {
+        uint32_t c = (col + i) % CELL_COLS;
+        uint32_t len = CELL_COLS - c < n - i ? CELL_COLS - c : n - i;
+        uint32_t tile = (col + i) / CELL_COLS + GRID_CELL_COLS * (row / CELL_ROWS);
+        uint32_t part = (frame[tile] >> ((row % CELL_ROWS) * CELL_COLS + c)) & (uint32_t) ((1ull << len) - 1);
+        bits |= part << i;
+        i += len;
+    }
+    return bits;
+}
+
+// Sets `n` (max 32) cells of a row starting at col, bit 0 = col. Goes a tile at a time.
+void conway_set_bits(conway_frame_t frame, uint32_t row, uint32_t col, uint32_t n, uint32_t bits) {
+    for (uint32_t i = 0; i < n;) {
+        uint32_t c = (col + i) % CELL_COLS;
+        uint32_t len = CELL_COLS - c < n - i ? CELL_COLS - c : n - i;
+        uint32_t tile = (col + i) / CELL_COLS + GRID_CELL_COLS * (row / CELL_ROWS);
+        uint32_t shift = (row % CELL_ROWS) * CELL_COLS + c;
+        uint32_t mask = (uint32_t) ((1ull << len) - 1) << shift;
+        frame[tile] = (frame[tile] & ~mask) | (((bits >> i) << shift) & mask);
+        i += len;
+    }
+}
+
+// Returns the state of cell `tile` (cell state layout), a copy
+uint32_t conway_get_tile(conway_frame_t frame, uint32_t tile) {
+    return frame[tile];
+}
+
+// Sets the state of cell `tile` (cell state layout), a copy
+void conway_set_tile(conway_frame_t frame, uint32_t tile, uint32_t state) {
+    frame[tile] = state;
+}
+
+#else
+#error  unknown CONWAY_ENGINE
+#endif
+
+#if (CONWAY_ENGINE != CONWAY_ENGINE_TILES)
+// Returns the state of cell `tile` (cell state layout), gathered a row at a time
+uint32_t conway_get_tile(conway_frame_t frame, uint32_t tile) {
+    uint32_t state = 0;
+    for (uint32_t row = 0; row < CELL_ROWS; row++) {
+        uint32_t grid_row = CELL_ROWS * (tile / GRID_CELL_COLS) + row;
+        state |= conway_get_bits(frame, grid_row, CELL_COLS * (tile % GRID_CELL_COLS), CELL_COLS) << (row * CELL_COLS);
+    }
+    return state;
+}
+
+// Sets the state of cell `tile` (cell state layout), scattered a row at a time
+void conway_set_tile(conway_frame_t frame, uint32_t tile, uint32_t state) {
+    for (uint32_t row = 0; row < CELL_ROWS; row++) {
+        uint32_t grid_row = CELL_ROWS * (tile / GRID_CELL_COLS) + row;
+        uint32_t bits = (state >> (row * CELL_COLS)) & (uint32_t) ((1ull << CELL_COLS) - 1);
+        conway_set_bits(frame, grid_row, CELL_COLS * (tile % GRID_CELL_COLS), CELL_COLS, bits);
+    }
+}
+#endif
+
+// Returns the tiles where frames a and b differ
+conway_tiles_t conway_tiles_changed(conway_frame_t a, conway_frame_t b) {
+    conway_tiles_t tiles = 0;
+    for (uint32_t tile = 0; tile < NUM_CELLS; tile++) {
+        if (conway_get_tile(a, tile) != conway_get_tile(b, tile)) tiles |= (conway_tiles_t) 1 << tile;
+    }
+    return tiles;
+}
+
+/*
+Generation history. The last CONWAY_HISTORY generations are kept packed (one
+word per tile, as conway_get_tile) in a ring with a hash each. A generation
+matching one of them means the wall is in a still life (period 1) or an
+oscillator.
+*/
+#ifndef CONWAY_HISTORY
+#define CONWAY_HISTORY  8   // generations kept, longest period detected
+#endif
+#define CONWAY_HISTORY_RING (CONWAY_HISTORY + 1)    // and the new generation's slot
+
+typedef uint32_t conway_packed_t[NUM_CELLS];
+
+conway_packed_t conway_history[CONWAY_HISTORY_RING];
+uint32_t conway_history_hash[CONWAY_HISTORY_RING];
+uint32_t conway_history_len = 0;    // generations in the ring, up to CONWAY_HISTORY
+uint32_t conway_history_head = 0;   // slot of the next generation
+
+// Packs frame into one word per tile and returns its hash
+uint32_t conway_pack(conway_packed_t packed, conway_frame_t frame) {
+    uint64_t hash = 14695981039346656037ull;    // FNV-1a over the tile words
+    for (uint32_t tile = 0; tile < NUM_CELLS; tile++) {
+        packed[tile] = conway_get_tile(frame, tile);
+        hash = (hash ^ packed[tile]) * 1099511628211ull;
+    }
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+// Adds a generation to the history.
+// Returns its period if it repeats one of the last CONWAY_HISTORY generations (1 = still life), else 0.
+uint32_t conway_history_push(conway_frame_t frame) {
+    uint32_t slot = conway_history_head;
+    uint32_t hash = conway_pack(conway_history[slot], frame);
+    uint32_t period = 0;
+    // the ring has a slot more than the history, the oldest generation is never the one just packed
+    for (uint32_t back = 1; back <= conway_history_len && period == 0; back++) {
+        uint32_t old = (slot + CONWAY_HISTORY_RING - back) % CONWAY_HISTORY_RING;
+        if (conway_history_hash[old] == hash &&
+            memcmp(conway_history[old], conway_history[slot], sizeof(conway_packed_t)) == 0) {
+            period = back;
+        }
+    }
+    conway_history_hash[slot] = hash;
+    conway_history_head = (slot + 1) % CONWAY_HISTORY_RING;
+    if (conway_history_len < CONWAY_HISTORY) conway_history_len++;
+    return period;
+}
+
+uint32_t conway_rand_state = 0x2545F491;
+
+// Returns a pseudo random number (xorshift32)
+uint32_t conway_rand(void) {
+    conway_rand_state ^= conway_rand_state << 13;
+    conway_rand_state ^= conway_rand_state >> 17;
+    conway_rand_state ^= conway_rand_state << 5;
+    return conway_rand_state;
+}
+
+// Brings a random tile of frame to life with random cells, about 1 in 3 alive
+void conway_noise(conway_frame_t frame) {
+    uint32_t tile = conway_rand() % NUM_CELLS;
+    uint32_t row0 = CELL_ROWS * (tile / GRID_CELL_COLS);
+    uint32_t col0 = CELL_COLS * (tile % GRID_CELL_COLS);
+    for (uint32_t row = row0; row < row0 + CELL_ROWS; row++) {
+        for (uint32_t col = col0; col < col0 + CELL_COLS; col++) {
+            if (conway_rand() % 3 == 0) conway_set(frame, row, col, 1);
+        }
+    }
+    conway_dirty |= (conway_tiles_t) 1 << tile;
+}
+
+/*
+Seed patterns live in flash (patterns.h, generated from patterns/ by host/rle2c),
+cropped to their live cells with one word per row, bit n = column n.
+*/
+typedef struct conway_pattern {
+    uint32_t rows;
+    uint32_t cols;              // max 32
+    const uint32_t *bits;       // one word per row
+} conway_pattern_t;
+
+#include "patterns.h"
+
+// Clears frame and copies a pattern into its middle, clipped to the wall
+void conway_load(conway_frame_t frame, const conway_pattern_t *pattern) {
+    uint32_t rows = pattern->rows < NUM_ROWS ? pattern->rows : NUM_ROWS;
+    uint32_t cols = pattern->cols < NUM_COLS ? pattern->cols : NUM_COLS;
+    uint32_t row0 = (NUM_ROWS - rows) / 2;
+    uint32_t col0 = (NUM_COLS - cols) / 2;
+    memset(frame, 0, sizeof(conway_frame_t));
+    for (uint32_t row = 0; row < rows; row++) {
+        conway_set_bits(frame, row0 + row, col0, cols, pattern->bits[row]);
+    }
+    conway_dirty = ALL_CELLS_MASK;  // a new pattern is evaluated everywhere
+    conway_history_len = 0;
+}
+
+/*
+Distributed Life. With CONWAY_DISTRIBUTED set every cell steps its own tile
+instead of the master stepping the grid. A tile only needs the edges of the 8
+tiles around it (its halo), so cells exchange just their edge fans (halo.h)
+and step with conway_step_tile.
+*/
+#ifndef CONWAY_DISTRIBUTED
+#define CONWAY_DISTRIBUTED  0
+#endif
+
+// Returns 1 if fan n is on the edge of a tile
+uint32_t conway_edge(uint32_t n) {
+    uint32_t row = n / CELL_COLS, col = n % CELL_COLS;
+    return row == 0 || row == CELL_ROWS - 1 || col == 0 || col == CELL_COLS - 1;
+}
+
+// Returns the edge fans of a tile packed together, EDGE_FANS_PER_CELL bits
+uint32_t conway_edge_pack(uint32_t tile) {
+    uint32_t edges = 0, bit = 0;
+    for (uint32_t n = 0; n < FANS_PER_CELL; n++) {
+        if (conway_edge(n)) edges |= ((tile >> n) & 1) << bit++;
+    }
+    return edges;
+}
+
+// Returns a tile holding packed edges, inner fans 0
+uint32_t conway_edge_unpack(uint32_t edges) {
+    uint32_t tile = 0, bit = 0;
+    for (uint32_t n = 0; n < FANS_PER_CELL; n++) {
+        if (conway_edge(n)) tile |= ((edges >> bit++) & 1) << n;
+    }
+    return tile;
+}
+
+// Returns random fan states for a tile, about 1 in 3 alive
+uint32_t conway_noise_tile(void) {
+    uint32_t tile = 0;
+    for (uint32_t n = 0; n < FANS_PER_CELL; n++) {
+        if (conway_rand() % 3 == 0) tile |= 1u << n;
+    }
+    return tile;
+}
@@ -0,0 +1,14 @@
+#ifndef CYAPICALLBACKS_H
+#define CYAPICALLBACKS_H
+
+// Component callbacks, enabled here and implemented in the project headers
+
+// UART RX interrupt, runs after the ISR has moved a byte into the RX buffer (rs485.h)
+#define UART_RXISR_EXIT_CALLBACK
+void UART_RXISR_ExitCallback(void);
+
+// SPIM TX interrupt on SPI done, releases the expander and starts the next write (gpiox.h)
+#define SPIM_GPIOX_TX_ISR_EXIT_CALLBACK
+void SPIM_GPIOX_TX_ISR_ExitCallback(void);
+
+#endif /* CYAPICALLBACKS_H */
@@ -1,42 +1,31 @@
 #include "gpiox.h"
 #include "physical.h"
 #include "project.h"
+#include "pwm.h"
 #include "stopwatch.h"
+#include "tach.h"
+#include "trace.h"
 
-#define FAN_DETECT_TIME     100 // time to wait for fan edge, units ms
+uint32_t fan_traced_state = 0;  // last state traced by fan_get_state
+uint32_t fan_validating = 0;    // fans switched and not at their state yet, bit n = fan n (see fan_set_ctrl)
 
-// Reads and combines all status registers into single uint32
-uint32_t fan_read_all(void) {
-    // Get tach signals from status registers
-    uint32_t Reg1 = Status_Reg_1_Read();  // tach 0-7
-    uint32_t Reg2 = Status_Reg_2_Read();  // tach 8-15
-    uint32_t Reg3 = Status_Reg_3_Read();  // tach 16-23
-    uint32_t Reg4 = Status_Reg_4_Read();  // tach 24-31
-
-    // Combine into single uint32_t
-    uint32_t tach_signals = (Reg1 | (Reg2 << 8) | (Reg3 << 16)| (Reg4 << 24));
-    return tach_signals;
-}
-
-// Returns the current fan state, blocks for 2 * FAN_DETECT_TIME.
+// Returns the current fan state (spinning fans), doesn't block.
+// Kept up to date by the tach sampling interrupt, see tach.h.
 uint32_t fan_get_state(void) {
-    // reset status registers
-    fan_read_all();
-    // Read fans twice to decide if spinning
-    CyDelay(FAN_DETECT_TIME);
-    uint32_t tmp_state = fan_read_all();
-    CyDelay(FAN_DETECT_TIME);
-    tmp_state &= fan_read_all();
-    return tmp_state;
+    uint32_t state = tach_get_state();
+    if (state != fan_traced_state) {
+        trace_put(TRACE_FANS, 0, 0, 0, state, 0, 0);    // only changes, it's read every loop
+        fan_traced_state = state;
+    }
+    return state;
 }
 
-// Starts/stops fans to match `state`.
+// Starts/stops fans to match `state`, fans that are on run at their PWM level (pwm.h).
 // Will block wait for `validate_ms` before giving up (timeout).
 // If validation is used and fails, the current state is return.
 // Otherwise, the set state is returned.
 uint32_t fan_set_state(uint32_t state, uint32_t validate_ms) {
-    gpiox_send(GPIOXA, ADDR_PORTA, ((uint8_t)(state >> 00)), ((uint8_t)(state >> 8)));
-    gpiox_send(GPIOXB, ADDR_PORTA, ((uint8_t)(state >> 16)), ((uint8_t)(state >> 24)));
+    pwm_set_state(state);
     
     // Validate new fan state before proceeding
     if (validate_ms) {
@@ -44,20 +33,106 @@ uint32_t fan_set_state(uint32_t state, uint32_t validate_ms) {
         uint32_t new_state = fan_get_state();
         while (new_state != state) {
             if (stopwatch_elapsed_ms(val_timer) >= validate_ms) return new_state;
+            CyDelay(TACH_SAMPLE_MS);
             new_state = fan_get_state();
         }
     }
     return state;
 }
 
-// Determines which fans are turning off, starts/resets validation timers, and sets fans to ctrl.
-// Handles commands from master.
+/*
+Coast down model. A fan switched off should slow down at its usual rate until
+the tach stops. Unpowered, it can only speed up or stay fast if a hand pushes
+it, which is human input and doesn't have to wait for the spin down to finish.
+The expected speed is a straight line from the speed when switched off, with
+the deceleration learned per fan from its previous spin downs. Fans slow down
+faster at speed, so the straight line is an upper bound for the real curve.
+*/
+#define FAN_DECEL_RPM_S     500     // default deceleration (full speed to stopped in ~6s)
+#define FAN_PUSH_RPM        400     // speed above the expected one that counts as a push
+#define FAN_COAST_SLACK_MS  1000    // time allowed past the expected stop
+#define FAN_LEARN_RPM       1000    // min speed when switched off to learn from a spin down
+
+// Coast status
+#define FAN_COASTING    0   // slowing down as expected
+#define FAN_STOPPED     1   // tach stopped
+#define FAN_PUSHED      2   // not slowing down, turned by a hand
+
+typedef struct {
+    uint32_t start;     // tach time of the first speed measurement
+    uint32_t rpm0;      // speed at start, 0 until measured
+    uint32_t rpm_min;   // lowest speed seen since
+    uint32_t min_at;    // tach time rpm_min was seen
+    uint8_t  pushed;
+} fan_coast_t;
+
+fan_coast_t fan_coast[FANS_PER_CELL];
+uint32_t fan_decel[FANS_PER_CELL];  // learned deceleration in RPM/s, 0 until learned
+
+// Starts tracking the spin down of a fan that was just switched off
+void fan_coast_start(uint32_t fan) {
+    fan_coast[fan].rpm0 = 0;
+    fan_coast[fan].pushed = 0;
+}
+
+// Checks a coasting fan against the model, call until it returns something other than FAN_COASTING
+uint8_t fan_coast_update(uint32_t fan) {
+    fan_coast_t *c = &fan_coast[fan];
+    uint32_t decel = fan_decel[fan] ? fan_decel[fan] : FAN_DECEL_RPM_S;
+    uint32_t now = tach_now_ms;
+
+    if (!(tach_get_state() & (1u << fan))) {
+        // Stopped, learn the deceleration from a full spin down (first to last speed measured)
+        uint32_t elapsed = c->min_at - c->start;
+        if (c->rpm0 >= FAN_LEARN_RPM && !c->pushed && elapsed) {
+            uint32_t sample = (c->rpm0 - c->rpm_min) * 1000 / elapsed;
+            fan_decel[fan] = decel + ((int32_t) (sample - decel)) / 4;
+        }
+        return FAN_STOPPED;
+    }
+
+    uint32_t rpm = tach_get_rpm(fan);
+    if (rpm == 0) return FAN_COASTING;  // no speed measured yet
+    if (c->rpm0 == 0) {
+        c->start = now;
+        c->rpm0 = rpm;
+        c->rpm_min = rpm;
+        c->min_at = now;
+    }
+    if (rpm < c->rpm_min) {
+        c->rpm_min = rpm;
+        c->min_at = now;
+    }
+
+    uint32_t elapsed = now - c->start;
+    uint32_t stop_ms = c->rpm0 * 1000 / decel;
+    uint32_t drop = decel * elapsed / 1000;
+    uint32_t expected = c->rpm0 > drop ? c->rpm0 - drop : 0;
+    if (rpm > c->rpm_min + FAN_PUSH_RPM ||      // speeding up
+        rpm > expected + FAN_PUSH_RPM ||        // not slowing down
+        elapsed > stop_ms + FAN_COAST_SLACK_MS) {   // should have stopped by now
+        c->pushed = 1;
+        return FAN_PUSHED;
+    }
+    return FAN_COASTING;
+}
+
+// Determines which fans are switching, starts/resets validation timers, and sets fans to ctrl.
+// Handles commands from master. validation[n] holds the start time of fan n's validation while it's in fan_validating.
 uint32_t fan_set_ctrl(uint32_t curr_state, uint32_t ctrl_state, uint32_t validation[FANS_PER_CELL]) {
     uint32_t has_changed = curr_state ^ ctrl_state;     // 1 = change is happening
     uint32_t turned_off = has_changed & curr_state;     // 1 = turned off (has changed and was 1)
-    for (uint32_t i = 0; i < FANS_PER_CELL; i++) {
-        if (turned_off & (1 << i)) validation[i] = stopwatch_start();   // set validatio time if fan turned off
-        else validation[i] = 0;     // else reset any validation
+    if (has_changed) trace_put(TRACE_VAL_START, 0, 0, 0, ctrl_state, has_changed, 0);
+    fan_validating |= has_changed;  // fans that aren't switching keep validating, a repeated command isn't a switch
+    for (uint32_t fans = has_changed; fans; fans &= fans - 1) {
+        uint32_t i = __builtin_ctz(fans);
+        validation[i] = stopwatch_start();
+        if (turned_off & (1u << i)) fan_coast_start(i);     // spin down is checked against the coast model
     }
     return fan_set_state(ctrl_state, 0);
 }
+
+// Returns 1 if no fan is still being validated (all switched fans got to their states)
+uint8_t fan_settled(void) {
+    return fan_validating == 0;
+}
@@ -1,3 +1,5 @@
+#pragma once
+#include "prof.h"
 #include "project.h"
 
 #define GPIOXA      0
@@ -14,26 +16,94 @@
 #define ADDR_PORTB    0x13       // GPIO port A register
 
 /*
-Writes two bytes via the SPIM device.
+Expander writes are queued and run from the SPIM TX interrupt (SPI done):
+a transfer is 4 bytes, which fits the SPIM hardware TX FIFO, so starting one
+never waits. When the last bit is out the interrupt releases the chip select
+and starts the next transfer, both expanders go out back to back without the
+CPU waiting on the bus. A queued write to a register that hasn't gone out yet
+is replaced by the newer data.
+*/
+#define GPIOX_QUEUE_SIZE    4   // two writes per expander
+
+typedef struct gpiox_xfer {
+    uint8_t gpiox;
+    uint8_t regA;
+    uint8_t dataA;
+    uint8_t dataB;
+} gpiox_xfer_t;
+
+gpiox_xfer_t gpiox_xfers[GPIOX_QUEUE_SIZE];
+volatile uint8_t gpiox_head = 0;    // transfer on the bus (or next to go)
+volatile uint8_t gpiox_tail = 0;    // next free slot
+volatile uint8_t gpiox_busy = 0;    // 1 while the transfer at gpiox_head is on the bus
+
+void gpiox_select(uint8_t gpiox, uint8_t enable) {
+    if (gpiox == GPIOXA) nCS_GPIOXA_Write(enable);
+    if (gpiox == GPIOXB) nCS_GPIOXB_Write(enable);
+}
+
+// Puts the next queued transfer on the bus. Interrupts must be off.
+void gpiox_start(void) {
+    if (gpiox_busy || gpiox_head == gpiox_tail) return;
+    gpiox_xfer_t *xfer = &gpiox_xfers[gpiox_head];
+    gpiox_busy = 1;
+    gpiox_select(xfer->gpiox, SPI_ENABLE);
+    SPIM_GPIOX_WriteByte(ADDR_MCP23S17); // IC hardware address
+    SPIM_GPIOX_WriteByte(xfer->regA);    // register A address
+    SPIM_GPIOX_WriteByte(xfer->dataA);   // register A data
+    SPIM_GPIOX_WriteByte(xfer->dataB);   // register B data
+}
+
+// SPIM TX ISR exit callback (enabled in cyapicallbacks.h), SPI done is its only source
+void SPIM_GPIOX_TX_ISR_ExitCallback(void) {
+    if (!gpiox_busy) return;
+    gpiox_select(gpiox_xfers[gpiox_head].gpiox, SPI_DISABLE);
+    gpiox_head = (gpiox_head + 1) % GPIOX_QUEUE_SIZE;
+    gpiox_busy = 0;
+    gpiox_start();
+}
+
+// Returns 1 once every queued write has reached the expanders
+uint8_t gpiox_idle(void) {
+    return gpiox_head == gpiox_tail;
+}
+
+// Waits until every queued write has reached the expanders
+void gpiox_flush(void) {
+    while (!gpiox_idle()) CyDelayUs(1);
+}
+
+/*
+Queues a write of two bytes, doesn't wait.
 Byte dataA is written to register regA
 The MCP23S17 will increment its addess pointer to the next slot (regB)
 Byte dataB will be written to this register (regB)
 */
 void gpiox_send(uint8_t gpiox, uint8_t regA, uint8_t dataA, uint8_t dataB) {
-    // Enable SPI slave
-    if (gpiox == GPIOXA) nCS_GPIOXA_Write(SPI_ENABLE);
-    if (gpiox == GPIOXB) nCS_GPIOXB_Write(SPI_ENABLE);
-    
-    // Send data
-    SPIM_GPIOX_WriteByte(ADDR_MCP23S17); // IC hardware address   
-    SPIM_GPIOX_WriteByte(regA);          // register A address 
-    SPIM_GPIOX_WriteByte(dataA);         // register A data
-    SPIM_GPIOX_WriteByte(dataB);         // register B data
-    while (0u == (SPIM_GPIOX_ReadTxStatus() & SPIM_GPIOX_STS_SPI_DONE)); // wait for TX to finish
-    
-    // Disable SPI slave
-    if (gpiox == GPIOXA) nCS_GPIOXA_Write(SPI_DISABLE);
-    if (gpiox == GPIOXB) nCS_GPIOXB_Write(SPI_DISABLE);
+    uint8 int_state = CyEnterCriticalSection();
+    PROF_BEGIN(PROF_GPIOX_SEND);
+    // Replace a write to the same registers that is still waiting
+    uint8_t i = gpiox_head;
+    if (gpiox_busy) i = (i + 1) % GPIOX_QUEUE_SIZE;
+    for (; i != gpiox_tail; i = (i + 1) % GPIOX_QUEUE_SIZE) {
+        if (gpiox_xfers[i].gpiox == gpiox && gpiox_xfers[i].regA == regA) {
+            gpiox_xfers[i].dataA = dataA;
+            gpiox_xfers[i].dataB = dataB;
+            PROF_END(PROF_GPIOX_SEND);
+            CyExitCriticalSection(int_state);
+            return;
+        }
+    }
+    // Wait for room, the interrupt frees slots
+    while ((uint8_t) ((gpiox_tail + 1) % GPIOX_QUEUE_SIZE) == gpiox_head) {
+        CyExitCriticalSection(int_state);
+        int_state = CyEnterCriticalSection();
+    }
+    gpiox_xfers[gpiox_tail] = (gpiox_xfer_t) {gpiox, regA, dataA, dataB};
+    gpiox_tail = (gpiox_tail + 1) % GPIOX_QUEUE_SIZE;
+    gpiox_start();
+    PROF_END(PROF_GPIOX_SEND);
+    CyExitCriticalSection(int_state);
 }
 
 void gpiox_init(void) {
@@ -42,4 +112,5 @@ void gpiox_init(void) {
     // Set all as outputs (IODIR = 0), default are inputs
     gpiox_send(GPIOXA, ADDR_IODIRA, 0, 0);
     gpiox_send(GPIOXB, ADDR_IODIRA, 0, 0);
+    gpiox_flush();
 }
@@ -0,0 +1,137 @@
+#pragma once
+#include "conway.h"
+#include "physical.h"
+#include "project.h"
+#include "rs485.h"
+#include "stopwatch.h"
+#include "trace.h"
+
+/*
+Distributed Life, cell side (CONWAY_DISTRIBUTED). Every cell steps its own
+tile, the master only starts halo rounds and steps (master.h).
+On UART_STEP RS485_STEP_HALO every cell broadcasts its edge fans (UART_HALO)
+in cell order: cell 0 right away, every other cell as soon as it hears the
+cell before it, or HALO_SLOT_MS per cell before it after the round started if
+that one stays quiet. Cells keep the edges of the 8 tiles around theirs.
+The master only sends UART_STEP RS485_STEP_GO after a round it heard every
+cell's halo in, so the whole wall steps together. A cell that still missed a
+halo (a corrupted byte the master got right) keeps its state and the halos it
+heard, and sets RS485_HALO_MISSED on its halos. The master doesn't step after
+such a round: it resends that cell the halos of the round the step used
+(RS485_HALO_RESYNC), the cell catches up once it has them all, and the round
+is run again. A master that reset since its last step has nothing to resend
+and steps anyway, the cell then drops the step it missed.
+*/
+#define HALO_SLOT_MS    5   // time a cell gets to send its halo when the cell before it is quiet
+
+uint8_t  halo_cell;                         // this cell
+uint8_t  halo_around[CONWAY_AROUND];        // cell at each position around this one (conway.h)
+uint16_t halo_needed = 0;                   // positions holding another cell
+uint16_t halo_heard = 0;                    // positions heard this round
+uint32_t halo_tiles[CONWAY_AROUND];         // edges heard, [4] unused
+uint8_t  halo_due = 0;                      // set while this cell's halo has to go out
+uint8_t  halo_go = 0;                       // set once the cell before this one sent its halo
+uint32_t halo_timer = 0;                    // started with the round
+uint32_t halo_sent_state = 0;               // state sent with the last halo
+uint8_t  halo_missed = 0;                   // set while this cell is a step behind
+uint16_t halo_missed_heard = 0;             // positions heard for that step, as halo_heard
+uint32_t halo_missed_tiles[CONWAY_AROUND];  // edges heard for it, as halo_tiles
+
+// Finds the cells around this one, handles wrap around
+void halo_init(uint8_t cell) {
+    halo_cell = cell;
+    for (uint32_t dr = 0; dr < 3; dr++) {
+        for (uint32_t dc = 0; dc < 3; dc++) {
+            uint32_t row = (cell / GRID_CELL_COLS + GRID_CELL_ROWS + dr - 1) % GRID_CELL_ROWS;
+            uint32_t col = (cell % GRID_CELL_COLS + GRID_CELL_COLS + dc - 1) % GRID_CELL_COLS;
+            uint32_t pos = dr * 3 + dc;
+            halo_around[pos] = (uint8_t) (col + GRID_CELL_COLS * row);
+            if (halo_around[pos] != cell) halo_needed |= 1 << pos;
+        }
+    }
+}
+
+// UART_STEP RS485_STEP_HALO received, starts a round
+void halo_start(void) {
+    halo_heard = 0;
+    halo_due = 1;
+    halo_go = (halo_cell == 0);
+    halo_timer = stopwatch_start();
+}
+
+// Keeps the edges of cell if it's around this one
+void halo_keep(uint32_t tiles[CONWAY_AROUND], uint16_t *heard, uint8_t cell, uint32_t tile) {
+    for (uint32_t pos = 0; pos < CONWAY_AROUND; pos++) {
+        if (((halo_needed >> pos) & 1) && halo_around[pos] == cell) {
+            tiles[pos] = tile;
+            *heard |= 1 << pos;
+        }
+    }
+}
+
+// UART_HALO received (command byte first), keeps the edges of the cells around this one.
+// Returns 1 once the master resent every halo of a step this cell missed, halo_catch_up() takes it then.
+uint8_t halo_receive(uint8_t *packet) {
+    uint8_t cell = packet[1];
+    uint32_t tile = conway_edge_unpack(rs485_get_halo(&packet[2]));
+    if (packet[0] & RS485_HALO_RESYNC) {
+        if (!halo_missed) return 0;
+        halo_keep(halo_missed_tiles, &halo_missed_heard, cell, tile);
+        return (halo_missed_heard & halo_needed) == halo_needed;
+    }
+    if (cell + 1 == halo_cell) halo_go = 1;
+    halo_keep(halo_tiles, &halo_heard, cell, tile);
+    return 0;
+}
+
+// Returns the ms until this cell's halo is due without hearing the cell before it, 0 if it's due
+uint32_t halo_wait_ms(void) {
+    uint32_t elapsed_ms = stopwatch_elapsed_ms(halo_timer);
+    uint32_t turn_ms = (uint32_t) halo_cell * HALO_SLOT_MS;
+    return (halo_go || elapsed_ms >= turn_ms) ? 0 : turn_ms - elapsed_ms;
+}
+
+// Sends this cell's halo once it's its turn. flags may carry RS485_SETTLED.
+void halo_poll(uint32_t state, uint8_t flags) {
+    if (!halo_due) return;
+    if (!halo_go && stopwatch_elapsed_ms(halo_timer) < (uint32_t) halo_cell * HALO_SLOT_MS) return;
+    if (state != halo_sent_state) flags |= RS485_HALO_CHANGED;
+    if (halo_missed) flags |= RS485_HALO_MISSED;
+    rs485_tx_halo(BROADCAST_ADDRESS, UART_HALO | flags, halo_cell, conway_edge_pack(state));
+    halo_sent_state = state;
+    halo_due = 0;
+}
+
+// Returns the next generation of state from the edges around it
+uint32_t halo_next(uint32_t state, const uint32_t tiles[CONWAY_AROUND]) {
+    uint32_t around[CONWAY_AROUND];
+    for (uint32_t pos = 0; pos < CONWAY_AROUND; pos++) {
+        around[pos] = ((halo_needed >> pos) & 1) ? tiles[pos] : state;
+    }
+    return conway_step_tile(around);
+}
+
+// UART_STEP RS485_STEP_GO received, returns the next generation of state (state if a halo is missing)
+uint32_t halo_step(uint32_t state) {
+    if ((halo_heard & halo_needed) != halo_needed) {
+        // flagged on this cell's halos until the master resent the ones missing
+        halo_missed = 1;
+        halo_missed_heard = halo_heard;
+        memcpy(halo_missed_tiles, halo_tiles, sizeof(halo_tiles));
+        trace_put(TRACE_STEP, 0, 0, 0, state, 0, 0);
+        return state;
+    }
+    halo_missed = 0;    // a step missed before this one is dropped, the master had nothing to resend
+    halo_heard = 0;     // a step uses a round once
+    uint32_t next = halo_next(state, halo_tiles);
+    trace_put(TRACE_STEP, 0, 1, 0, next, 0, 0);
+    return next;
+}
+
+// Takes the step this cell missed once halo_receive() returned 1, returns the next generation of state
+uint32_t halo_catch_up(uint32_t state) {
+    halo_missed = 0;
+    uint32_t next = halo_next(state, halo_missed_tiles);
+    trace_put(TRACE_STEP, 0, 2, 0, next, 0, 0);
+    return next;
+}
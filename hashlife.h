@@ -0,0 +1,246 @@
+#pragma once
+#include "conway.h"
+#include "physical.h"
+#include "project.h"
+
+/*
+HashLife, for jumping the wall far into the future (seed search, previews).
+The torus is unrolled into a plane tiled with copies of the wall and stored as
+a quadtree of shared nodes: a node of level l is 2^l cells across, made of 4
+nodes of level l-1, and every distinct node exists once (hash consed). Each
+node remembers its center half advanced 2^step generations, so repeated
+regions, and repeated times, are computed once.
+Nodes come from a fixed pool. When it runs out the pool is cleared and the
+advance is done in two halves, so a small pool is slower but still correct.
+Only walls with power of two sides tile the quadtree, others aren't supported.
+*/
+#ifndef HASHLIFE_NODES
+#define HASHLIFE_NODES  1024    // node pool, ~14 bytes per node with 16 bit indices
+#endif
+
+#if (HASHLIFE_NODES < 0x10000)
+typedef uint16_t hashlife_t;    // node index, 0 and 1 are the dead and alive cells (level 0)
+#else
+typedef uint32_t hashlife_t;
+#endif
+#define HASHLIFE_NONE   ((hashlife_t) ~0u)  // no node, the pool ran out
+#define HASHLIFE_NW     0
+#define HASHLIFE_NE     1
+#define HASHLIFE_SW     2
+#define HASHLIFE_SE     3
+
+typedef struct {
+    hashlife_t child[4];    // HASHLIFE_NW to HASHLIFE_SE
+    hashlife_t result;      // center half advanced 2^step generations, HASHLIFE_NONE if not computed
+    hashlife_t next;        // next node in the hash bucket
+    uint8_t    level;
+    uint8_t    step;
+} hashlife_node_t;
+
+hashlife_node_t hashlife_nodes[HASHLIFE_NODES];
+hashlife_t hashlife_buckets[HASHLIFE_NODES];
+uint32_t   hashlife_count = 0;  // nodes in use
+
+// Levels of the smallest node holding the wall
+uint32_t hashlife_wall_level(void) {
+    uint32_t level = 0;
+    while ((1u << level) < NUM_ROWS || (1u << level) < NUM_COLS) level++;
+    return level;
+}
+
+// Empties the pool, only the two cells are left
+void hashlife_reset(void) {
+    for (uint32_t i = 0; i < HASHLIFE_NODES; i++) hashlife_buckets[i] = HASHLIFE_NONE;
+    for (hashlife_t cell = 0; cell < 2; cell++) {
+        hashlife_nodes[cell].level = 0;
+        hashlife_nodes[cell].result = HASHLIFE_NONE;
+    }
+    hashlife_count = 2;
+}
+
+// Returns the node made of the 4 given ones, HASHLIFE_NONE if one of them is or the pool is full
+hashlife_t hashlife_join(hashlife_t nw, hashlife_t ne, hashlife_t sw, hashlife_t se) {
+    if (nw == HASHLIFE_NONE || ne == HASHLIFE_NONE || sw == HASHLIFE_NONE || se == HASHLIFE_NONE) return HASHLIFE_NONE;
+    uint32_t bucket = (nw * 0x9E3779B1u ^ ne * 0x85EBCA77u ^ sw * 0xC2B2AE3Du ^ se * 0x27D4EB2Fu) % HASHLIFE_NODES;
+    for (hashlife_t i = hashlife_buckets[bucket]; i != HASHLIFE_NONE; i = hashlife_nodes[i].next) {
+        hashlife_node_t *n = &hashlife_nodes[i];
+        if (n->child[HASHLIFE_NW] == nw && n->child[HASHLIFE_NE] == ne &&
+            n->child[HASHLIFE_SW] == sw && n->child[HASHLIFE_SE] == se) return i;
+    }
+    if (hashlife_count == HASHLIFE_NODES) return HASHLIFE_NONE;
+    hashlife_t i = (hashlife_t) hashlife_count++;
+    hashlife_node_t *n = &hashlife_nodes[i];
+    n->child[HASHLIFE_NW] = nw;
+    n->child[HASHLIFE_NE] = ne;
+    n->child[HASHLIFE_SW] = sw;
+    n->child[HASHLIFE_SE] = se;
+    n->level = hashlife_nodes[nw].level + 1;
+    n->result = HASHLIFE_NONE;
+    n->next = hashlife_buckets[bucket];
+    hashlife_buckets[bucket] = i;
+    return i;
+}
+
+// Returns quadrant q of node i
+hashlife_t hashlife_child(hashlife_t i, uint32_t q) {
+    return hashlife_nodes[i].child[q];
+}
+
+// Returns the cell at (row,col) of node i
+uint32_t hashlife_get(hashlife_t i, uint32_t row, uint32_t col) {
+    for (uint32_t level = hashlife_nodes[i].level; level > 0; level--) {
+        uint32_t half = 1u << (level - 1);
+        uint32_t q = (row >= half ? HASHLIFE_SW : HASHLIFE_NW) + (col >= half ? 1 : 0);
+        i = hashlife_child(i, q);
+        row &= half - 1;
+        col &= half - 1;
+    }
+    return i;
+}
+
+// Returns the generation after the center 2x2 of a level 2 node
+hashlife_t hashlife_step_4x4(hashlife_t i) {
+    uint32_t bits = 0;   // bit 4 * row + col
+    for (uint32_t row = 0; row < 4; row++) {
+        for (uint32_t col = 0; col < 4; col++) bits |= hashlife_get(i, row, col) << (4 * row + col);
+    }
+    hashlife_t next[4];
+    for (uint32_t q = 0; q < 4; q++) {
+        uint32_t row = 1 + q / 2, col = 1 + q % 2;
+        uint32_t count = 0;
+        for (uint32_t r = row - 1; r <= row + 1; r++) {
+            for (uint32_t c = col - 1; c <= col + 1; c++) {
+                if (r != row || c != col) count += (bits >> (4 * r + c)) & 1;
+            }
+        }
+        // Alive next if 3 neighbors, or 2 neighbors and already alive
+        next[q] = count == 3 || (count == 2 && ((bits >> (4 * row + col)) & 1));
+    }
+    return hashlife_join(next[HASHLIFE_NW], next[HASHLIFE_NE], next[HASHLIFE_SW], next[HASHLIFE_SE]);
+}
+
+// Returns the center half of node i (level >= 2) advanced 2^step generations, step <= level - 2
+hashlife_t hashlife_result(hashlife_t i, uint32_t step) {
+    hashlife_node_t *n = &hashlife_nodes[i];
+    if (n->result != HASHLIFE_NONE && n->step == step) return n->result;
+    uint32_t level = n->level;
+    hashlife_t result;
+    if (level == 2) {
+        result = hashlife_step_4x4(i);
+    } else {
+        // The 9 overlapping nodes of half the size, row by row
+        hashlife_t nw = n->child[HASHLIFE_NW], ne = n->child[HASHLIFE_NE];
+        hashlife_t sw = n->child[HASHLIFE_SW], se = n->child[HASHLIFE_SE];
+        hashlife_t part[9] = {
+            nw,
+            hashlife_join(hashlife_child(nw, HASHLIFE_NE), hashlife_child(ne, HASHLIFE_NW),
+                          hashlife_child(nw, HASHLIFE_SE), hashlife_child(ne, HASHLIFE_SW)),
+            ne,
+            hashlife_join(hashlife_child(nw, HASHLIFE_SW), hashlife_child(nw, HASHLIFE_SE),
+                          hashlife_child(sw, HASHLIFE_NW), hashlife_child(sw, HASHLIFE_NE)),
+            hashlife_join(hashlife_child(nw, HASHLIFE_SE), hashlife_child(ne, HASHLIFE_SW),
+                          hashlife_child(sw, HASHLIFE_NE), hashlife_child(se, HASHLIFE_NW)),
+            hashlife_join(hashlife_child(ne, HASHLIFE_SW), hashlife_child(ne, HASHLIFE_SE),
+                          hashlife_child(se, HASHLIFE_NW), hashlife_child(se, HASHLIFE_NE)),
+            sw,
+            hashlife_join(hashlife_child(sw, HASHLIFE_NE), hashlife_child(se, HASHLIFE_NW),
+                          hashlife_child(sw, HASHLIFE_SE), hashlife_child(se, HASHLIFE_SW)),
+            se,
+        };
+        // First half of the time (or all of it if it's less than half the most this level can do)
+        uint32_t first = step < level - 2 ? step : level - 3;
+        hashlife_t c[9];
+        for (uint32_t p = 0; p < 9; p++) {
+            if (part[p] == HASHLIFE_NONE) return HASHLIFE_NONE;
+            c[p] = hashlife_result(part[p], first);
+            if (c[p] == HASHLIFE_NONE) return HASHLIFE_NONE;
+        }
+        if (step < level - 2) {
+            // Done, the center of the 9 results
+            result = hashlife_join(
+                hashlife_join(hashlife_child(c[0], HASHLIFE_SE), hashlife_child(c[1], HASHLIFE_SW),
+                              hashlife_child(c[3], HASHLIFE_NE), hashlife_child(c[4], HASHLIFE_NW)),
+                hashlife_join(hashlife_child(c[1], HASHLIFE_SE), hashlife_child(c[2], HASHLIFE_SW),
+                              hashlife_child(c[4], HASHLIFE_NE), hashlife_child(c[5], HASHLIFE_NW)),
+                hashlife_join(hashlife_child(c[3], HASHLIFE_SE), hashlife_child(c[4], HASHLIFE_SW),
+                              hashlife_child(c[6], HASHLIFE_NE), hashlife_child(c[7], HASHLIFE_NW)),
+                hashlife_join(hashlife_child(c[4], HASHLIFE_SE), hashlife_child(c[5], HASHLIFE_SW),
+                              hashlife_child(c[7], HASHLIFE_NE), hashlife_child(c[8], HASHLIFE_NW)));
+        } else {
+            // Second half of the time on the 4 overlapping quarters of the results
+            hashlife_t quarter[4] = {
+                hashlife_join(c[0], c[1], c[3], c[4]),
+                hashlife_join(c[1], c[2], c[4], c[5]),
+                hashlife_join(c[3], c[4], c[6], c[7]),
+                hashlife_join(c[4], c[5], c[7], c[8]),
+            };
+            for (uint32_t q = 0; q < 4; q++) {
+                if (quarter[q] == HASHLIFE_NONE) return HASHLIFE_NONE;
+                quarter[q] = hashlife_result(quarter[q], first);
+            }
+            result = hashlife_join(quarter[0], quarter[1], quarter[2], quarter[3]);
+        }
+    }
+    if (result == HASHLIFE_NONE) return HASHLIFE_NONE;
+    n = &hashlife_nodes[i];
+    n->result = result;
+    n->step = (uint8_t) step;
+    return result;
+}
+
+// Returns the node of the given level at (row,col) of the plane tiled with frame
+hashlife_t hashlife_build(conway_frame_t frame, uint32_t level, uint32_t row, uint32_t col) {
+    if (level == 0) return (hashlife_t) conway_get(frame, row % NUM_ROWS, col % NUM_COLS);
+    uint32_t half = 1u << (level - 1);
+    return hashlife_join(hashlife_build(frame, level - 1, row, col),
+                         hashlife_build(frame, level - 1, row, col + half),
+                         hashlife_build(frame, level - 1, row + half, col),
+                         hashlife_build(frame, level - 1, row + half, col + half));
+}
+
+// Advances frame 2^k generations on the torus, one try with the nodes left in the pool
+uint8_t hashlife_try(conway_frame_t frame, uint32_t k) {
+    // Big enough that the result covers the wall and 2^k generations fit
+    uint32_t wall = hashlife_wall_level();
+    uint32_t level = wall + 1 > k + 2 ? wall + 1 : k + 2;
+    if (level < 2) level = 2;
+    hashlife_t world = hashlife_build(frame, wall, 0, 0);
+    for (uint32_t l = wall; l < level; l++) world = hashlife_join(world, world, world, world);
+    if (world == HASHLIFE_NONE) return 0;
+    hashlife_t result = hashlife_result(world, k);
+    if (result == HASHLIFE_NONE) return 0;
+    // The result starts 2^(level - 2) cells into the world, both ways
+    uint32_t offset = 1u << (level - 2);
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        for (uint32_t col = 0; col < NUM_COLS; col++) {
+            uint32_t r = (row + NUM_ROWS - offset % NUM_ROWS) % NUM_ROWS;
+            uint32_t c = (col + NUM_COLS - offset % NUM_COLS) % NUM_COLS;
+            conway_set(frame, row, col, hashlife_get(result, r, c));
+        }
+    }
+    return 1;
+}
+
+// Advances frame 2^k generations on the torus. Returns 0 if the pool is too small, frame is then part way.
+uint8_t hashlife_advance(conway_frame_t frame, uint32_t k) {
+    if (hashlife_count == 0) hashlife_reset();
+    if (hashlife_try(frame, k)) return 1;
+    // Pool full, start over with an empty one and go in two halves if that's not enough
+    hashlife_reset();
+    if (hashlife_try(frame, k)) return 1;
+    hashlife_reset();
+    return k > 0 && hashlife_advance(frame, k - 1) && hashlife_advance(frame, k - 1);
+}
+
+// Advances frame 2^k generations on the torus. Returns 0 and leaves frame as it was if the wall isn't supported
+// or the pool is too small.
+uint8_t conway_hashlife_advance(conway_frame_t frame, uint32_t k) {
+    if ((NUM_ROWS & (NUM_ROWS - 1)) || (NUM_COLS & (NUM_COLS - 1))) return 0;
+    conway_frame_t next;    // the jump goes here, the first half of a split one may succeed alone
+    memcpy(next, frame, sizeof(conway_frame_t));
+    if (!hashlife_advance(next, k)) return 0;
+    memcpy(frame, next, sizeof(conway_frame_t));
+    conway_dirty = ALL_CELLS_MASK;  // a jump can change anything
+    conway_history_len = 0;
+    return 1;
+}
@@ -0,0 +1,147 @@
+// Times the firmware's hot paths on the host: the Life engines, the grid <->
+// cell state mapping and packet building, at every wall size and engine the
+// Makefile builds (bench_kernels.c). Prints one CSV line per result.
+//
+//   bench [-q] [-b baseline.csv] [-x ratio]
+//
+// -q  quick run, shorter timing
+// -b  compare against an earlier run, results slower than the baseline by
+//     more than the ratio are listed on stderr and the exit code is 1
+// -x  allowed slowdown for -b (default 1.25)
+#include "project.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MIN_NS    200000000ull    // each timing runs at least this long
+#define BENCH_RUNS      3               // timings per result, the fastest counts
+#define BENCH_MAX       256             // baseline results kept
+
+struct bench_wall_entry {
+    const char   *name;
+    bench_wall_t  run;
+};
+
+// Generated by the Makefile from the benchmarked walls
+extern const struct bench_wall_entry bench_walls[];
+extern const int bench_num_walls;
+
+volatile uint32_t bench_sink;
+
+static uint64_t min_ns = BENCH_MIN_NS;
+static double   max_ratio = 1.25;
+static int      regressions = 0;
+
+static struct {
+    char   key[64];
+    double ns;
+} baseline[BENCH_MAX];
+static int num_baseline = 0;
+
+static const char *engine_name(int engine) {
+    return engine == 2 ? "tiles" : engine ? "bitboard" : "array";
+}
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ull + (uint64_t) t.tv_nsec;
+}
+
+static void load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "bench: can't open %s\n", path);
+        exit(2);
+    }
+    char line[256], name[32], engine[16];
+    int rows, cols;
+    unsigned long long iters;
+    double ns;
+    while (fgets(line, sizeof(line), f) && num_baseline < BENCH_MAX) {
+        if (sscanf(line, "%31[^,],%15[^,],%d,%d,%llu,%lf", name, engine, &rows, &cols, &iters, &ns) != 6) continue;
+        snprintf(baseline[num_baseline].key, sizeof(baseline[0].key), "%s,%s,%d,%d", name, engine, rows, cols);
+        baseline[num_baseline].ns = ns;
+        num_baseline++;
+    }
+    fclose(f);
+}
+
+void bench_time(const char *name, int engine, int rows, int cols, void (*fn)(void)) {
+    uint64_t iters = 1;
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        // Double the iterations until a timing is long enough, then keep them for the other runs
+        for (;;) {
+            uint64_t start = now_ns();
+            for (uint64_t i = 0; i < iters; i++) fn();
+            uint64_t elapsed = now_ns() - start;
+            if (elapsed >= min_ns) {
+                double ns = (double) elapsed / iters;
+                if (run == 0 || ns < best) best = ns;
+                break;
+            }
+            iters *= 2;
+        }
+    }
+    printf("%s,%s,%d,%d,%llu,%.1f\n", name, engine_name(engine), rows, cols, (unsigned long long) iters, best);
+    fflush(stdout);
+
+    char key[64];
+    snprintf(key, sizeof(key), "%s,%s,%d,%d", name, engine_name(engine), rows, cols);
+    for (int i = 0; i < num_baseline; i++) {
+        if (strcmp(baseline[i].key, key) == 0 && best > baseline[i].ns * max_ratio) {
+            fprintf(stderr, "regression %s: %.1f ns, baseline %.1f ns\n", key, best, baseline[i].ns);
+            regressions++;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *baseline_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "qb:x:")) != -1) {
+        switch (opt) {
+        case 'q': min_ns = BENCH_MIN_NS / 10; break;
+        case 'b': baseline_path = optarg; break;
+        case 'x': max_ratio = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-q] [-b baseline.csv] [-x ratio]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (baseline_path) load_baseline(baseline_path);
+
+    printf("bench,engine,rows,cols,iters,ns_per_op\n");
+    for (int i = 0; i < bench_num_walls; i++) bench_walls[i].run();
+    return regressions ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Hardware the benchmarked code touches, doing nothing
+
+uint8 CyEnterCriticalSection(void) { return 0; }
+void  CyExitCriticalSection(uint8 savedIntrStatus) { (void) savedIntrStatus; }
+void  CyDelayUs(uint16 microseconds) { (void) microseconds; }
+void  CySysTickStart(void) { }
+void  CySysTickSetReload(uint32 value) { (void) value; }
+uint32 CySysTickGetValue(void) { return 0; }
+uint32 CySysTickGetReload(void) { return 0; }
+void  CySysTickClear(void) { }
+uint32 CySysTickGetCountFlag(void) { return 0; }
+cySysTickCallback CySysTickSetCallback(uint32 number, cySysTickCallback function) { (void) number; (void) function; return 0; }
+uint32 Timer_ReadCounter(void) { return 0; }
+uint32 Timer_ReadPeriod(void) { return 0; }
+void  UART_ClearRxBuffer(void) { }
+uint8 UART_GetRxBufferSize(void) { return 0; }
+uint8 UART_ReadRxData(void) { return 0; }
+void  UART_SetTxAddressMode(uint8 addressMode) { (void) addressMode; }
+void  UART_SetRxAddress2(uint8 address) { (void) address; }
+
+void UART_PutArray(const uint8 string[], uint8 byteCount) {
+    for (uint8 i = 0; i < byteCount; i++) bench_sink += string[i];
+}
@@ -0,0 +1,11 @@
+#pragma once
+// Host benchmarks of the firmware's hot paths (bench.c, bench_kernels.c).
+#include <stdint.h>
+
+typedef void (*bench_wall_t)(void);
+
+// Times fn and prints a result line for it
+void bench_time(const char *name, int engine, int rows, int cols, void (*fn)(void));
+
+// Where packet bytes go instead of the bus, so building them isn't optimized away
+extern volatile uint32_t bench_sink;
@@ -0,0 +1,94 @@
+// Firmware hot paths at one wall size and Life engine. Compiled once per size
+// and engine by the Makefile, every object keeps only its bench_wall_* entry
+// point global, like the sim's nodes.
+#include "project.h"
+#include "bench.h"
+#include "../hashlife.h"
+#include "../master.h"
+
+// Random soup, about 1 in 3 alive
+static void bench_soup(conway_frame_t frame) {
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        for (uint32_t col = 0; col < NUM_COLS; col++) {
+            conway_set(frame, row, col, conway_rand() % 3 == 0);
+        }
+    }
+}
+
+// A full generation, every tile evaluated
+static void bench_update_frame(void) {
+    conway_dirty = ALL_CELLS_MASK;
+    conway_update_frame();
+}
+
+// A generation with the active tile tracking, the soup dies down to a few active tiles
+static void bench_update_frame_active(void) {
+    conway_update_frame();
+}
+
+static void bench_has_changed(void) {
+    bench_sink += conway_has_changed();
+}
+
+static void bench_history_push(void) {
+    bench_sink += conway_history_push(conway_curr_frame);
+}
+
+// Grid to cell states and the UART_WRITE_ALL packets
+static void bench_write_grid(void) {
+    master_write_grid(conway_curr_frame, ALL_CELLS_MASK);
+    master_poll();
+}
+
+// Cell states to grid, every cell reported a change
+static void bench_read_grid(void) {
+    master_read_grid_finish(conway_last_frame);
+}
+
+// Jumps from the same soup every time, with an empty pool so nothing is remembered from the last run
+static conway_frame_t bench_hashlife_soup;
+
+static void bench_hashlife(uint32_t k) {
+    memcpy(conway_last_frame, bench_hashlife_soup, sizeof(conway_frame_t));
+    hashlife_reset();
+    bench_sink += conway_hashlife_advance(conway_last_frame, k);
+}
+
+static void bench_hashlife_k10(void) {
+    bench_hashlife(10);
+}
+
+static void bench_hashlife_k20(void) {
+    bench_hashlife(20);
+}
+
+static void bench_rs485_tx(void) {
+    rs485_tx(0, UART_WRITE, bench_sink);
+}
+
+void bench_wall(void) {
+    bench_soup(conway_curr_frame);
+    bench_time("update_frame", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_update_frame);
+    bench_soup(conway_curr_frame);
+    conway_dirty = ALL_CELLS_MASK;
+    bench_time("update_frame_active", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_update_frame_active);
+
+    bench_soup(conway_curr_frame);
+    bench_soup(conway_last_frame);
+    bench_time("has_changed", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_has_changed);
+    bench_time("history_push", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_history_push);
+
+    // 2^k generations at once, compare with update_frame * 2^k
+    bench_soup(bench_hashlife_soup);
+    bench_time("hashlife_k10", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_hashlife_k10);
+    bench_time("hashlife_k20", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_hashlife_k20);
+
+    bench_time("write_grid", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_write_grid);
+    for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
+        master_cell_states[cell] = conway_rand();
+        master_cell_valid[cell] = 1;
+        master_cell_changed[cell] = 1;
+    }
+    bench_time("read_grid", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_read_grid);
+    bench_time("rs485_tx", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, bench_rs485_tx);
+}
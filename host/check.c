@@ -0,0 +1,61 @@
+// Checks the firmware's Life engines on the host, at every wall size and
+// engine the Makefile builds (check_kernels.c): the engines against each other,
+// the active tile tracking, distributed Life (a cell stepping its tile from
+// its halo) and HashLife jumps against plain stepping. Prints one line per
+// wall and engine, the exit code is 1 if anything didn't match.
+//
+//   check
+#include "project.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct check_wall_entry {
+    const char   *name;     // <engine>_<GRID_CELL_ROWS>_<GRID_CELL_COLS>
+    check_wall_t  run;
+};
+
+// Generated by the Makefile from the checked walls
+extern const struct check_wall_entry check_walls[];
+extern const int check_num_walls;
+
+static int failures = 0;
+
+static const char *engine_name(int engine) {
+    return engine == 2 ? "tiles" : engine ? "bitboard" : "array";
+}
+
+void check_fail(const char *what, int engine, int rows, int cols, uint32_t soup, uint32_t gen) {
+    fprintf(stderr, "mismatch %s,%s,%d,%d: soup %u generation %u\n", what, engine_name(engine), rows, cols, soup, gen);
+    failures++;
+}
+
+int main(void) {
+    static check_gens_t gens, first;
+    const char *first_wall = "";
+    for (int i = 0; i < check_num_walls; i++) {
+        const char *wall = strchr(check_walls[i].name, '_') + 1;
+        int engine = atoi(check_walls[i].name);
+        int before = failures;
+        check_walls[i].run(gens);
+        // Every engine of a wall steps the same soups, the first one is the reference
+        if (strcmp(wall, first_wall) != 0) {
+            memcpy(first, gens, sizeof(first));
+            first_wall = wall;
+        } else {
+            for (uint32_t soup = 0; soup < CHECK_SOUPS; soup++) {
+                for (uint32_t gen = 0; gen <= CHECK_GENS; gen++) {
+                    if (gens[soup][gen] == first[soup][gen]) continue;
+                    fprintf(stderr, "mismatch engines,%s,%s cells: soup %u generation %u\n", engine_name(engine), wall, soup, gen);
+                    failures++;
+                    break;
+                }
+            }
+        }
+        int rows = atoi(wall), cols = atoi(strchr(wall, '_') + 1);
+        printf("check %s %dx%d cells %s\n", engine_name(engine), rows, cols, failures == before ? "ok" : "FAILED");
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+// Host checks of the firmware's Life engines (check.c, check_kernels.c).
+#include <stdint.h>
+
+#define CHECK_SOUPS     8       // random soups per wall
+#define CHECK_GENS      64      // generations each soup is followed for
+#define CHECK_JUMP_MAX  6       // HashLife jumps 2^0 to 2^CHECK_JUMP_MAX generations, 2^CHECK_JUMP_MAX <= CHECK_GENS
+
+// Hash of every generation of every soup, the same soups on every engine
+typedef uint32_t check_gens_t[CHECK_SOUPS][CHECK_GENS + 1];
+
+typedef void (*check_wall_t)(check_gens_t gens);
+
+// Reports a mismatch, `what` failed at generation gen of soup
+void check_fail(const char *what, int engine, int rows, int cols, uint32_t soup, uint32_t gen);
@@ -0,0 +1,93 @@
+// Life engine checks at one wall size and engine. Compiled once per size and
+// engine by the Makefile, every object keeps only its check_wall_* entry
+// point global, like bench_kernels.c.
+#include "project.h"
+#include "check.h"
+#include "../hashlife.h"
+
+#define CHECK_SOUP_SEED 0x5EED0000u
+
+// Random soup, about 1 in 3 alive, the same for every engine
+static void check_soup(conway_frame_t frame, uint32_t soup) {
+    conway_rand_state = CHECK_SOUP_SEED + soup;
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        for (uint32_t col = 0; col < NUM_COLS; col++) {
+            conway_set(frame, row, col, conway_rand() % 3 == 0);
+        }
+    }
+}
+
+// FNV-1a over every cell, the same on every engine
+static uint32_t check_hash(conway_frame_t frame) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        for (uint32_t col = 0; col < NUM_COLS; col++) hash = (hash ^ conway_get(frame, row, col)) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns the tile dr tile rows and dc tile columns away from tile, on the torus
+static uint32_t check_tile_at(uint32_t tile, int dr, int dc) {
+    uint32_t row = (tile / GRID_CELL_COLS + GRID_CELL_ROWS + dr) % GRID_CELL_ROWS;
+    uint32_t col = (tile % GRID_CELL_COLS + GRID_CELL_COLS + dc) % GRID_CELL_COLS;
+    return col + GRID_CELL_COLS * row;
+}
+
+// Returns 1 if every tile of next is what a cell steps from its tile of curr and its halo (halo.h)
+static uint32_t check_distributed(conway_frame_t curr, conway_frame_t next) {
+    for (uint32_t tile = 0; tile < NUM_CELLS; tile++) {
+        uint32_t around[CONWAY_AROUND];
+        for (int dr = -1; dr < 2; dr++) {
+            for (int dc = -1; dc < 2; dc++) {
+                uint32_t state = conway_get_tile(curr, check_tile_at(tile, dr, dc));
+                around[(dr + 1) * 3 + dc + 1] = dr || dc ? conway_edge_unpack(conway_edge_pack(state)) : state;
+            }
+        }
+        if (conway_step_tile(around) != conway_get_tile(next, tile)) return 0;
+    }
+    return 1;
+}
+
+// Steps every soup with all tiles evaluated into gens, and checks the active tile tracking, distributed Life
+// and HashLife jumps against it
+void check_wall(check_gens_t gens) {
+    static conway_frame_t soup, prev, frame;
+    for (uint32_t s = 0; s < CHECK_SOUPS; s++) {
+        check_soup(soup, s);
+
+        // Every tile evaluated every generation, the reference
+        memcpy(conway_curr_frame, soup, sizeof(conway_frame_t));
+        gens[s][0] = check_hash(conway_curr_frame);
+        for (uint32_t gen = 1; gen <= CHECK_GENS; gen++) {
+            memcpy(prev, conway_curr_frame, sizeof(conway_frame_t));
+            conway_dirty = ALL_CELLS_MASK;
+            conway_update_frame();
+            gens[s][gen] = check_hash(conway_curr_frame);
+            if (!check_distributed(prev, conway_curr_frame)) {
+                check_fail("distributed", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, s, gen);
+            }
+        }
+
+        // Only the tiles that can change evaluated, as the master steps
+        memcpy(conway_curr_frame, soup, sizeof(conway_frame_t));
+        conway_dirty = ALL_CELLS_MASK;
+        for (uint32_t gen = 1; gen <= CHECK_GENS; gen++) {
+            conway_update_frame();
+            if (check_hash(conway_curr_frame) != gens[s][gen]) {
+                check_fail("update_frame_active", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, s, gen);
+                break;
+            }
+        }
+
+        // HashLife jumps. Walls with sides that aren't powers of two aren't supported, a jump that fails leaves the
+        // frame as it was.
+        uint8_t supported = !(NUM_ROWS & (NUM_ROWS - 1)) && !(NUM_COLS & (NUM_COLS - 1));
+        for (uint32_t k = 0; k <= CHECK_JUMP_MAX; k++) {
+            memcpy(frame, soup, sizeof(conway_frame_t));
+            uint8_t jumped = conway_hashlife_advance(frame, k);
+            if (jumped != supported || check_hash(frame) != gens[s][jumped ? 1u << k : 0]) {
+                check_fail("hashlife", CONWAY_ENGINE, NUM_ROWS, NUM_COLS, s, 1u << k);
+            }
+        }
+    }
+}
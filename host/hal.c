@@ -0,0 +1,833 @@
+// Virtual hardware behind host/project.h.
+//
+// Every node (the master and each cell) is a copy of main.c running on its own
+// stack. Nodes are scheduled cooperatively on virtual time: each node keeps a
+// local clock and API calls advance it. A node only runs ahead of the others
+// as far as no byte can be put on the bus in its past (one byte time), then
+// gives up the CPU, so interrupts for received bytes fire at the right time.
+// Interrupt handlers run instantly and can't be interrupted.
+#include "project.h"
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+
+#define HAL_CALL_US         1           // time charged per API call, keeps busy-waits moving
+#define NODE_STACK_SIZE     (1 << 20)
+
+// RS485 bus: start + 8 data + mark/space + stop bits
+#define UART_BAUD           115200
+#define UART_BYTE_US        ((11 * 1000000 + UART_BAUD - 1) / UART_BAUD)
+
+// SPI to the MCP23S17s, 1MHz clock
+#define SPI_BYTE_US         8
+#define HAL_EEPROM_ROW_US   20000       // EEPROM row erase and program
+#define HAL_SPC_LOAD_US     5           // SPC row latch load
+#define MCP_OPCODE_WRITE    0x40
+#define MCP_IODIRA          0x00
+#define MCP_IODIRB          0x01
+#define MCP_GPIOA           0x12
+#define MCP_GPIOB           0x13
+#define MCP_OLATA           0x14
+#define MCP_OLATB           0x15
+
+// Fan model
+#define FAN_FULL_RPM        3000.0
+#define FAN_PULSES_PER_REV  2.0
+#define FAN_SPINUP_US       1000000.0   // stopped to full speed when powered
+#define FAN_SPINDOWN_US     6000000.0   // full speed to stopped when coasting
+#define FAN_TACH_MIN        0.05        // below this fraction of full speed the tach stops toggling
+#define FAN_HAND_SPEED      0.6         // speed a hand flick gets a fan to
+
+struct fan {
+    double   speed;         // fraction of full speed
+    double   pulses;        // tach pulses since power up
+    uint64_t t;             // time the model was last advanced to
+    uint64_t hold_until;    // held still by a hand until this time
+    uint64_t latched;       // pulse count at the last status register read
+    int      driven;        // powered by the expander output
+    uint64_t touched_at;    // touch waiting for the cell to switch the fan, 0 if none
+};
+
+struct touch {
+    uint64_t at;
+    uint32_t hold_ms;
+    uint8_t  fan;
+    uint8_t  kind;
+};
+
+struct bus_byte {
+    uint64_t t;             // time the byte is fully received
+    uint8_t  byte;
+    uint8_t  mark;          // address byte
+    uint8_t  src;
+};
+
+struct node {
+    uint8_t     addr;
+    int         is_master;
+    sim_entry_t entry;
+    ucontext_t  ctx;
+    void       *stack;
+    uint64_t    t;
+    uint64_t    wake;       // time the node is advancing to, it won't transmit before unless interrupted
+    uint8_t     in_isr;
+    uint8_t     irq_off;    // in a critical section
+    uint8_t     irq_fired;  // an interrupt ran, wakes __WFI
+    uint64_t    run_ns;     // host time spent running this node (hal_cycles)
+    uint64_t    run_from;   // host time it was last switched to
+
+    // SysTick
+    cySysTickCallback systick_cb[CY_SYS_SYST_NUM_OF_CALLBACKS];
+    uint8_t     systick_on;
+    uint8_t     systick_flag;   // COUNTFLAG
+    uint8_t     systick_pend;   // interrupt pending
+    uint32_t    systick_reload; // reload register, loaded when the count reaches 0
+    uint32_t    systick_top;    // value the count started from
+    uint64_t    systick_base;   // time it started
+    uint64_t    systick_pend_t; // time the pending interrupt came in
+
+    void      (*rx_isr)(void);  // UART RX ISR exit callback
+
+    // UART
+    uint8_t     rx[UART_RX_BUFFER_SIZE];
+    uint8_t     rx_head;
+    uint8_t     rx_count;
+    uint8_t     rx_match;   // last address byte on the bus was ours
+    uint8_t     rx_address2;
+    uint8_t     tx_mode;
+    size_t      bus_cursor; // next bus byte to look at
+
+    // SPI and expanders
+    uint8_t     cs[2];
+    uint8_t     spi[16];
+    uint8_t     spi_len;
+    uint64_t    spi_done;
+    void      (*spi_isr)(void); // SPIM TX ISR exit callback, on SPI done
+    uint8_t     spi_irq;        // SPI done interrupt due at spi_done
+    uint8_t     iodir[2][2];
+    uint8_t     olat[2][2];
+
+    // EEPROM and SPC
+    uint8_t     eeprom[CY_EEPROM_SIZE];
+    uint8_t     spc_row[CY_EEPROM_SIZEOF_ROW];  // row latch
+    uint8_t     spc_locked;
+    uint8_t     spc_status;     // status of the last SPC command, CY_SPC_STATUS_SUCCESS or an error
+    uint64_t    spc_done;       // end of the SPC command in progress
+
+    // Fans and human input
+    struct fan    fans[SIM_FANS_PER_CELL];
+    struct touch *touches;  // sorted by time
+    size_t        n_touches;
+    size_t        next_touch;
+};
+
+static struct node  nodes[SIM_MAX_NODES];
+static int          num_nodes;
+static struct node *cur;
+static ucontext_t   sched_ctx;
+
+static struct bus_byte *bus;
+static size_t           bus_len;
+static size_t           bus_cap;
+static uint64_t         bus_free_at;
+static uint8_t          bus_last_src;       // node that drove the bus last
+static uint64_t         pending_req[256];   // end time of the last unanswered request per address
+
+static uint64_t         push_coasting_us;   // flick fans this long after they are switched off
+
+static struct sim_stats stats = { .rsp_us_min = UINT64_MAX };
+
+// ---------------------------------------------------------------------------
+// Scheduling
+
+// Host monotonic clock in ns
+static uint64_t host_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// Earliest time node n could put a byte on the bus: when it wakes up, or when an
+// RX interrupt could fire if it has one. Other nodes' interrupts are ignored
+// for the latter, which is conservative as long as only one node has an RX ISR.
+static uint64_t earliest_tx(struct node *n) {
+    uint64_t e = n->wake;
+    if (n->rx_isr) {
+        uint64_t rx = n->bus_cursor < bus_len ? bus[n->bus_cursor].t : UINT64_MAX;
+        for (int i = 0; i < num_nodes; i++) {
+            struct node *m = &nodes[i];
+            if (m == n) continue;
+            uint64_t em = (m == cur || m->rx_isr) ? m->t : m->wake;
+            if (em != UINT64_MAX && em + UART_BYTE_US < rx) rx = em + UART_BYTE_US;
+        }
+        if (rx < n->t) rx = n->t;
+        if (rx < e) e = rx;
+    }
+    return e;
+}
+
+// Bus bytes arriving before this time are already known. Other nodes don't run
+// while the current one does, so it only moves when the current node transmits.
+static uint64_t horizon_cache;
+
+static uint64_t bus_horizon(void) {
+    if (horizon_cache) return horizon_cache;
+    uint64_t t = UINT64_MAX;
+    for (int i = 0; i < num_nodes; i++) {
+        if (&nodes[i] == cur) continue;
+        uint64_t e = earliest_tx(&nodes[i]);
+        if (e < t) t = e;
+    }
+    horizon_cache = t == UINT64_MAX ? UINT64_MAX : t + UART_BYTE_US;
+    return horizon_cache;
+}
+
+static void uart_rx_byte(struct node *n, const struct bus_byte *b);
+
+static void systick_isr(struct node *n);
+
+static void run_isr(void (*isr)(void));
+
+// us the SysTick count takes from `top` down to 0 and back to the reload
+static uint64_t systick_len(uint32_t top) {
+    uint64_t us = ((uint64_t) top + 1) * 1000000ull / CYDEV_BCLK__SYSCLK__HZ;
+    return us ? us : 1;
+}
+
+// Time of the next SysTick interrupt of node n
+static uint64_t systick_due(struct node *n) {
+    if (!n->systick_on) return UINT64_MAX;
+    return n->systick_pend ? n->systick_pend_t : n->systick_base + systick_len(n->systick_top);
+}
+
+// Advances the current node to `target`, running interrupts on the way.
+// With `wfi` it stops early, right after the first interrupt.
+static void hal_run_to(uint64_t target, int wfi) {
+    if (cur->in_isr) {
+        cur->t = target;
+        return;
+    }
+    cur->wake = target;
+    cur->irq_fired = 0;
+    while (cur->t < target) {
+        uint64_t safe = bus_horizon();
+        uint64_t step = target < safe ? target : safe;
+        if (step <= cur->t) {
+            // too far ahead, let the others catch up
+            swapcontext(&cur->ctx, &sched_ctx);
+            continue;
+        }
+        if (!cur->irq_off) {
+            // interrupts in time order
+            for (;;) {
+                uint64_t rx = cur->bus_cursor < bus_len ? bus[cur->bus_cursor].t : UINT64_MAX;
+                uint64_t tick = systick_due(cur);
+                uint64_t spi = cur->spi_irq ? cur->spi_done : UINT64_MAX;
+                if (rx > step && tick > step && spi > step) break;
+                if (rx <= tick && rx <= spi) {
+                    struct bus_byte *b = &bus[cur->bus_cursor++];
+                    if (b->t > cur->t) cur->t = b->t;
+                    uart_rx_byte(cur, b);
+                } else if (spi <= tick) {
+                    if (spi > cur->t) cur->t = spi;
+                    cur->spi_irq = 0;
+                    run_isr(cur->spi_isr);
+                } else {
+                    if (tick > cur->t) cur->t = tick;
+                    systick_isr(cur);
+                }
+                if (wfi && cur->irq_fired) {
+                    cur->wake = cur->t;
+                    return;
+                }
+            }
+        }
+        if (step > cur->t) cur->t = step;     // interrupts may have taken longer
+    }
+}
+
+static void hal_advance(uint64_t target) {
+    hal_run_to(target, 0);
+}
+
+static void hal_enter(void) {
+    hal_advance(cur->t + HAL_CALL_US);
+}
+
+static void run_isr(void (*isr)(void)) {
+    cur->in_isr = 1;
+    isr();
+    cur->in_isr = 0;
+    cur->irq_fired = 1;
+}
+
+static void node_start(void) {
+    cur->entry();
+    // firmware never returns, park the node if it does
+    cur->t = UINT64_MAX;
+    cur->wake = UINT64_MAX;
+    swapcontext(&cur->ctx, &sched_ctx);
+}
+
+void sim_add_node(uint8_t addr, int is_master, sim_entry_t entry) {
+    if (num_nodes == SIM_MAX_NODES) {
+        fprintf(stderr, "sim: too many nodes\n");
+        exit(1);
+    }
+    struct node *n = &nodes[num_nodes++];
+    memset(n, 0, sizeof(*n));
+    n->addr = addr;
+    n->is_master = is_master;
+    n->entry = entry;
+    n->cs[0] = n->cs[1] = 1;
+    n->rx_address2 = UART_RX_HW_ADDRESS2;
+    memset(n->iodir, 0xFF, sizeof(n->iodir));   // expanders power up as inputs
+    n->stack = malloc(NODE_STACK_SIZE);
+    getcontext(&n->ctx);
+    n->ctx.uc_stack.ss_sp = n->stack;
+    n->ctx.uc_stack.ss_size = NODE_STACK_SIZE;
+    n->ctx.uc_link = NULL;
+    makecontext(&n->ctx, node_start, 0);
+}
+
+void sim_run(uint64_t until_us) {
+    for (;;) {
+        struct node *next = NULL;
+        for (int i = 0; i < num_nodes; i++) {
+            if (next == NULL || nodes[i].t < next->t) next = &nodes[i];
+        }
+        if (next == NULL || next->t >= until_us) return;
+        cur = next;
+        horizon_cache = 0;
+        cur->run_from = host_ns();
+        swapcontext(&sched_ctx, &cur->ctx);
+        cur->run_ns += host_ns() - cur->run_from;
+    }
+}
+
+uint64_t sim_now_us(void) {
+    uint64_t now = UINT64_MAX;
+    for (int i = 0; i < num_nodes; i++) {
+        if (nodes[i].t < now) now = nodes[i].t;
+    }
+    return now;
+}
+
+const struct sim_stats *sim_get_stats(void) {
+    return &stats;
+}
+
+static struct node *find_node(uint8_t addr) {
+    for (int i = 0; i < num_nodes; i++) {
+        if (nodes[i].addr == addr) return &nodes[i];
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Fans
+
+// Integrates speed and tach pulses of a fan up to time t
+static void fan_advance(struct fan *f, uint64_t t) {
+    while (f->t < t) {
+        if (f->hold_until > f->t) {
+            uint64_t end = f->hold_until < t ? f->hold_until : t;
+            f->speed = 0;
+            f->t = end;
+            continue;
+        }
+        double dt = (double) (t - f->t);
+        double s0 = f->speed;
+        double s1;
+        double area;    // integral of speed over dt
+        if (f->driven) {
+            double t_full = (1.0 - s0) * FAN_SPINUP_US;
+            if (t_full < dt) {
+                s1 = 1.0;
+                area = (s0 + 1.0) / 2 * t_full + (dt - t_full);
+            } else {
+                s1 = s0 + dt / FAN_SPINUP_US;
+                area = (s0 + s1) / 2 * dt;
+            }
+        } else {
+            double t_stop = s0 * FAN_SPINDOWN_US;
+            if (t_stop < dt) {
+                s1 = 0.0;
+                area = s0 / 2 * t_stop;
+            } else {
+                s1 = s0 - dt / FAN_SPINDOWN_US;
+                area = (s0 + s1) / 2 * dt;
+            }
+        }
+        if ((s0 + s1) / 2 >= FAN_TACH_MIN) {
+            f->pulses += area * FAN_FULL_RPM * FAN_PULSES_PER_REV / 60e6;
+        }
+        f->speed = s1;
+        f->t = t;
+    }
+}
+
+// Applies human input up to time t, then brings every fan to time t
+static void fans_sync(struct node *n, uint64_t t) {
+    while (n->next_touch < n->n_touches && n->touches[n->next_touch].at <= t) {
+        struct touch *tc = &n->touches[n->next_touch++];
+        struct fan *f = &n->fans[tc->fan];
+        fan_advance(f, tc->at);
+        if ((tc->kind == SIM_TOUCH_HOLD) == f->driven) {
+            f->touched_at = tc->at;
+            stats.touches++;
+        }
+        if (tc->kind == SIM_TOUCH_HOLD) {
+            f->speed = 0;
+            f->hold_until = tc->at + (uint64_t) tc->hold_ms * 1000;
+        } else if (f->speed < FAN_HAND_SPEED) {
+            f->speed = FAN_HAND_SPEED;
+        }
+    }
+    for (int i = 0; i < SIM_FANS_PER_CELL; i++) fan_advance(&n->fans[i], t);
+}
+
+void sim_touch(uint8_t cell, uint8_t fan, int kind, uint64_t at_us, uint32_t hold_ms) {
+    struct node *n = find_node(cell);
+    if (n == NULL || n->is_master || fan >= SIM_FANS_PER_CELL) return;
+    n->touches = realloc(n->touches, (n->n_touches + 1) * sizeof(*n->touches));
+    size_t i = n->n_touches++;
+    while (i > n->next_touch && n->touches[i - 1].at > at_us) {
+        n->touches[i] = n->touches[i - 1];
+        i--;
+    }
+    n->touches[i] = (struct touch) { .at = at_us, .hold_ms = hold_ms, .fan = fan, .kind = (uint8_t) kind };
+}
+
+void sim_push_coasting(uint32_t after_ms) {
+    push_coasting_us = (uint64_t) after_ms * 1000;
+}
+
+uint32_t sim_cell_outputs(uint8_t cell) {
+    struct node *n = find_node(cell);
+    uint32_t out = 0;
+    if (n == NULL) return 0;
+    for (int i = 0; i < SIM_FANS_PER_CELL; i++) {
+        if (n->fans[i].driven) out |= (1u << i);
+    }
+    return out;
+}
+
+uint32_t sim_cell_spinning(uint8_t cell) {
+    struct node *n = find_node(cell);
+    uint32_t spinning = 0;
+    if (n == NULL) return 0;
+    fans_sync(n, sim_now_us());
+    for (int i = 0; i < SIM_FANS_PER_CELL; i++) {
+        if (n->fans[i].speed >= FAN_TACH_MIN) spinning |= (1u << i);
+    }
+    return spinning;
+}
+
+// Sticky register: a bit is set if its fan's tach toggled since the last read
+static uint8 status_reg_read(int reg) {
+    hal_enter();
+    fans_sync(cur, cur->t);
+    uint8 bits = 0;
+    for (int i = 0; i < 8; i++) {
+        struct fan *f = &cur->fans[reg * 8 + i];
+        uint64_t count = (uint64_t) f->pulses;
+        if (count != f->latched) bits |= (uint8) (1u << i);
+        f->latched = count;
+    }
+    return bits;
+}
+
+uint8 Status_Reg_1_Read(void) { return status_reg_read(0); }
+uint8 Status_Reg_2_Read(void) { return status_reg_read(1); }
+uint8 Status_Reg_3_Read(void) { return status_reg_read(2); }
+uint8 Status_Reg_4_Read(void) { return status_reg_read(3); }
+
+// ---------------------------------------------------------------------------
+// SPI and MCP23S17 expanders
+
+static void expander_apply(int x) {
+    uint8_t *s = cur->spi;
+    if (cur->spi_len < 3 || s[0] != MCP_OPCODE_WRITE) return;
+    for (int i = 2; i < cur->spi_len; i++) {
+        uint8_t reg = (uint8_t) (s[1] + i - 2);     // sequential addressing (IOCON.SEQOP = 0)
+        if (reg == MCP_IODIRA || reg == MCP_IODIRB) cur->iodir[x][reg - MCP_IODIRA] = s[i];
+        if (reg == MCP_GPIOA || reg == MCP_GPIOB) cur->olat[x][reg - MCP_GPIOA] = s[i];
+        if (reg == MCP_OLATA || reg == MCP_OLATB) cur->olat[x][reg - MCP_OLATA] = s[i];
+    }
+    fans_sync(cur, cur->t);
+    for (int port = 0; port < 2; port++) {
+        uint8_t out = cur->olat[x][port] & (uint8_t) ~cur->iodir[x][port];
+        for (int b = 0; b < 8; b++) {
+            struct fan *f = &cur->fans[x * 16 + port * 8 + b];
+            int driven = (out >> b) & 1;
+            if (push_coasting_us && f->driven && !driven) {
+                sim_touch(cur->addr, (uint8_t) (x * 16 + port * 8 + b), SIM_TOUCH_SPIN, cur->t + push_coasting_us, 0);
+            }
+            if (driven != f->driven && f->touched_at) {
+                uint64_t latency = cur->t - f->touched_at;
+                stats.input_samples++;
+                stats.input_us_sum += latency;
+                if (latency > stats.input_us_max) stats.input_us_max = latency;
+                f->touched_at = 0;
+            }
+            f->driven = driven;
+        }
+    }
+}
+
+static void chip_select(int x, uint8 value) {
+    hal_enter();
+    if (value == 0 && cur->cs[x]) {
+        cur->spi_len = 0;
+    } else if (value && cur->cs[x] == 0) {
+        expander_apply(x);
+    }
+    cur->cs[x] = value ? 1 : 0;
+}
+
+void nCS_GPIOXA_Write(uint8 value) { chip_select(0, value); }
+void nCS_GPIOXB_Write(uint8 value) { chip_select(1, value); }
+
+void hal_spim_start(void (*tx_isr)(void)) {
+    hal_enter();
+    cur->spi_isr = tx_isr;
+}
+
+void SPIM_GPIOX_WriteByte(uint8 txDataByte) {
+    hal_enter();
+    if (cur->spi_len < sizeof(cur->spi)) cur->spi[cur->spi_len++] = txDataByte;
+    uint64_t start = cur->spi_done > cur->t ? cur->spi_done : cur->t;
+    cur->spi_done = start + SPI_BYTE_US;
+    if (cur->spi_isr) cur->spi_irq = 1;     // fires once the FIFO has drained
+}
+
+uint8 SPIM_GPIOX_ReadTxStatus(void) {
+    hal_enter();
+    return cur->t >= cur->spi_done ? SPIM_GPIOX_STS_SPI_DONE : 0;
+}
+
+// ---------------------------------------------------------------------------
+// RS485 bus
+
+// A byte arrives: address filter, RX buffer, then the RX ISR
+static void uart_rx_byte(struct node *n, const struct bus_byte *b) {
+    if (b->src == n->addr) return;
+    if (b->mark) {
+        n->rx_match = (b->byte == n->addr) || b->byte == n->rx_address2;
+        return;
+    }
+    if (!n->rx_match) return;
+    if (n->rx_count == UART_RX_BUFFER_SIZE) {
+        stats.rx_overflow++;
+        return;
+    }
+    n->rx[(n->rx_head + n->rx_count++) % UART_RX_BUFFER_SIZE] = b->byte;
+    n->irq_fired = 1;   // the UART's own RX interrupt
+    if (n->rx_isr) run_isr(n->rx_isr);
+}
+
+// Drops bus bytes every node has already looked at
+static void bus_compact(void) {
+    size_t done = bus_len;
+    for (int i = 0; i < num_nodes; i++) {
+        if (nodes[i].bus_cursor < done) done = nodes[i].bus_cursor;
+    }
+    if (done < 4096) return;
+    memmove(bus, bus + done, (bus_len - done) * sizeof(*bus));
+    bus_len -= done;
+    for (int i = 0; i < num_nodes; i++) nodes[i].bus_cursor -= done;
+}
+
+static void bus_observe(const uint8 *data, uint8 len, uint64_t end) {
+    struct node *dst = find_node(data[0]);
+    stats.packets[len > 1 ? data[1] : 0]++;
+    telemetry_observe(data, len);
+    if (cur->is_master && dst != NULL) {
+        stats.requests++;
+        if (pending_req[data[0]]) stats.unanswered++;
+        pending_req[data[0]] = end;
+    } else if (dst != NULL && dst->is_master) {
+        stats.responses++;
+        if (pending_req[cur->addr]) {
+            uint64_t rsp = end - pending_req[cur->addr];
+            stats.rsp_samples++;
+            stats.rsp_us_sum += rsp;
+            if (rsp < stats.rsp_us_min) stats.rsp_us_min = rsp;
+            if (rsp > stats.rsp_us_max) stats.rsp_us_max = rsp;
+            pending_req[cur->addr] = 0;
+        }
+    }
+}
+
+void hal_uart_start(void (*rx_isr)(void)) {
+    hal_enter();
+    cur->rx_isr = rx_isr;
+}
+
+void UART_ClearRxBuffer(void) {
+    hal_enter();
+    cur->rx_head = 0;
+    cur->rx_count = 0;
+}
+
+uint8 UART_GetRxBufferSize(void) {
+    hal_enter();
+    return cur->rx_count;
+}
+
+uint8 UART_ReadRxData(void) {
+    hal_enter();
+    if (cur->rx_count == 0) return 0;
+    uint8 byte = cur->rx[cur->rx_head];
+    cur->rx_head = (uint8) ((cur->rx_head + 1) % UART_RX_BUFFER_SIZE);
+    cur->rx_count--;
+    return byte;
+}
+
+void UART_SetTxAddressMode(uint8 addressMode) {
+    hal_enter();
+    cur->tx_mode = addressMode;
+}
+
+void UART_SetRxAddress2(uint8 address) {
+    hal_enter();
+    cur->rx_address2 = address;
+}
+
+// Bytes go out back to back once the bus is free, the first one carries the mark bit
+void UART_PutArray(const uint8 string[], uint8 byteCount) {
+    hal_enter();
+    if (byteCount == 0) return;
+    uint64_t start = cur->t;
+    if (bus_free_at > start) {
+        // a node's own packets just queue up in its TX buffer
+        if (bus_last_src != cur->addr) stats.contention++;
+        start = bus_free_at;
+    }
+    bus_last_src = cur->addr;
+    if (bus_len + byteCount > bus_cap) {
+        bus_cap = (bus_len + byteCount) * 2;
+        bus = realloc(bus, bus_cap * sizeof(*bus));
+    }
+    for (uint8 i = 0; i < byteCount; i++) {
+        bus[bus_len++] = (struct bus_byte) {
+            .t = start + (uint64_t) (i + 1) * UART_BYTE_US,
+            .byte = string[i],
+            .mark = (i == 0 && cur->tx_mode == UART_SET_MARK),
+            .src = cur->addr,
+        };
+    }
+    bus_free_at = start + (uint64_t) byteCount * UART_BYTE_US;
+    horizon_cache = 0;
+    stats.bytes += byteCount;
+    stats.busy_us += (uint64_t) byteCount * UART_BYTE_US;
+    bus_observe(string, byteCount, bus_free_at);
+    bus_compact();
+}
+
+// ---------------------------------------------------------------------------
+// Delays and sleep
+
+void CyDelay(uint32 milliseconds) {
+    hal_advance(cur->t + (uint64_t) milliseconds * 1000);
+}
+
+void CyDelayUs(uint16 microseconds) {
+    hal_advance(cur->t + microseconds);
+}
+
+uint8 CyEnterCriticalSection(void) {
+    uint8 was_off = cur->irq_off;
+    cur->irq_off = 1;
+    return was_off;
+}
+
+// Interrupts that came in meanwhile run as soon as they are enabled again
+void CyExitCriticalSection(uint8 savedIntrStatus) {
+    cur->irq_off = savedIntrStatus;
+    hal_enter();
+}
+
+// Sleeps until the next interrupt. With interrupts masked it still wakes up on
+// one (and returns right away if one is pending), here its ISR runs a bit early.
+void __WFI(void) {
+    uint8 masked = cur->irq_off;
+    cur->irq_off = 0;
+    hal_enter();
+    if (!(masked && cur->irq_fired)) hal_run_to(systick_due(cur), 1);
+    cur->irq_off = masked;
+}
+
+// ---------------------------------------------------------------------------
+// SysTick
+
+// Brings node n's count up to its time: every time it reached 0 it started again from the reload register
+static void systick_roll(struct node *n) {
+    while (n->systick_on && n->t >= n->systick_base + systick_len(n->systick_top)) {
+        n->systick_base += systick_len(n->systick_top);
+        n->systick_top = n->systick_reload;
+        n->systick_flag = 1;
+        if (!n->systick_pend) n->systick_pend_t = n->systick_base;
+        n->systick_pend = 1;
+    }
+}
+
+static void systick_isr(struct node *n) {
+    systick_roll(n);
+    n->systick_pend = 0;
+    for (uint32 i = 0; i < CY_SYS_SYST_NUM_OF_CALLBACKS; i++) {
+        if (n->systick_cb[i]) run_isr(n->systick_cb[i]);
+    }
+    n->irq_fired = 1;
+}
+
+// Starts counting from the reload, 1ms unless set before (like cy_boot)
+void CySysTickStart(void) {
+    hal_enter();
+    if (cur->systick_on) return;
+    if (cur->systick_reload == 0) cur->systick_reload = CYDEV_BCLK__SYSCLK__HZ / 1000 - 1;
+    cur->systick_on = 1;
+    cur->systick_top = cur->systick_reload;
+    cur->systick_base = cur->t;
+}
+
+// Takes effect when the count next reaches 0
+void CySysTickSetReload(uint32 value) {
+    hal_enter();
+    systick_roll(cur);
+    cur->systick_reload = value;
+}
+
+uint32 CySysTickGetReload(void) {
+    hal_enter();
+    return cur->systick_reload;
+}
+
+// The count starts again from the reload, without an interrupt
+void CySysTickClear(void) {
+    hal_enter();
+    systick_roll(cur);
+    cur->systick_top = cur->systick_reload;
+    cur->systick_base = cur->t;
+    cur->systick_flag = 0;
+}
+
+// Counts down to 0, once per bus clock. Keeps counting while the interrupt is held off.
+uint32 CySysTickGetValue(void) {
+    hal_enter();
+    if (!cur->systick_on) return 0;
+    systick_roll(cur);
+    uint64_t cycles = (cur->t - cur->systick_base) * (CYDEV_BCLK__SYSCLK__HZ / 1000000);
+    return cycles > cur->systick_top ? 0 : cur->systick_top - (uint32) cycles;
+}
+
+// Returns 1 if the count reached 0 since the last call (COUNTFLAG, reading clears it)
+uint32 CySysTickGetCountFlag(void) {
+    hal_enter();
+    systick_roll(cur);
+    uint32 flag = cur->systick_flag;
+    cur->systick_flag = 0;
+    return flag;
+}
+
+cySysTickCallback CySysTickSetCallback(uint32 number, cySysTickCallback function) {
+    hal_enter();
+    cySysTickCallback old = cur->systick_cb[number];
+    cur->systick_cb[number] = function;
+    return old;
+}
+
+// ---------------------------------------------------------------------------
+// EEPROM
+
+uint8 dieTemperature[2];
+
+uint8 *sim_eeprom(uint8_t addr) {
+    struct node *n = find_node(addr);
+    return n ? n->eeprom : NULL;
+}
+
+uint8 *hal_eeprom(void) {
+    return cur->eeprom;
+}
+
+uint8 hal_spc_idle(void) {
+    hal_enter();
+    return cur->t >= cur->spc_done;
+}
+
+uint8 hal_spc_status(void) {
+    hal_enter();
+    return cur->spc_status;
+}
+
+void CyEEPROM_Start(void) {
+    hal_enter();
+}
+
+cystatus CySetTemp(void) {
+    hal_enter();
+    return CYRET_SUCCESS;
+}
+
+cystatus CySpcLock(void) {
+    hal_enter();
+    if (cur->spc_locked) return 0x04u;  // CYRET_LOCKED
+    cur->spc_locked = 1;
+    return CYRET_SUCCESS;
+}
+
+void CySpcUnlock(void) {
+    hal_enter();
+    cur->spc_locked = 0;
+}
+
+cystatus CySpcLoadRow(uint8 array, const uint8 buffer[], uint16 size) {
+    hal_enter();
+    if (array != CY_SPC_FIRST_EE_ARRAYID || size != CY_EEPROM_SIZEOF_ROW || cur->t < cur->spc_done) return 0x01u;
+    memcpy(cur->spc_row, buffer, size);
+    cur->spc_status = CY_SPC_STATUS_SUCCESS;
+    cur->spc_done = cur->t + HAL_SPC_LOAD_US;
+    return CYRET_STARTED;
+}
+
+// Writes the latch to EEPROM row `row` (a row number, like EEPROM_Write). The row reads back new right away,
+// only the SPC stays busy for the write time.
+cystatus CySpcWriteRow(uint8 array, uint16 row, uint8 tempPolarity, uint8 tempMagnitude) {
+    hal_enter();
+    if (array != CY_SPC_FIRST_EE_ARRAYID || row >= CY_EEPROM_NUMBER_ROWS || cur->t < cur->spc_done) return 0x01u;
+    memcpy(cur->eeprom + row * CY_EEPROM_SIZEOF_ROW, cur->spc_row, CY_EEPROM_SIZEOF_ROW);
+    cur->spc_status = CY_SPC_STATUS_SUCCESS;
+    cur->spc_done = cur->t + HAL_EEPROM_ROW_US;
+    return CYRET_STARTED;
+}
+
+// ---------------------------------------------------------------------------
+// Cycle counter
+
+// The node's host run time (other nodes running meanwhile left out) stands in for the DWT cycle counter,
+// so spans show how long the firmware's code takes on the host. Reading it doesn't take virtual time.
+uint32 hal_cycles(void) {
+    return (uint32) (cur->run_ns + (host_ns() - cur->run_from));
+}
+
+// ---------------------------------------------------------------------------
+// Timer
+
+void Timer_Start(void) {
+    hal_enter();
+}
+
+uint32 Timer_ReadCounter(void) {
+    hal_enter();
+    return UINT32_MAX - (uint32) (cur->t / 1000);
+}
+
+uint32 Timer_ReadPeriod(void) {
+    hal_enter();
+    return UINT32_MAX;
+}
@@ -0,0 +1,116 @@
+#pragma once
+// Host stand-in for the PSoC Creator generated project.h.
+// Declares the subset of the generated component APIs used by the firmware,
+// implemented on virtual hardware by hal.c.
+#include <stdint.h>
+#include <string.h>
+
+#include "cyapicallbacks.h"
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+
+// UART hardware address of the node being built, set per node by the Makefile
+#ifndef FOL_NODE_ADDRESS
+#define FOL_NODE_ADDRESS    8
+#endif
+
+// The simulator dumps every node's event trace (trace.h, host/sim -T)
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE        1
+#endif
+
+// cy_boot
+#define CyGlobalIntEnable   do { } while (0)
+void  CyDelay(uint32 milliseconds);
+void  CyDelayUs(uint16 microseconds);
+uint8 CyEnterCriticalSection(void);
+void  CyExitCriticalSection(uint8 savedIntrStatus);
+void  __WFI(void);
+
+// SysTick, clocked from the bus clock
+#define CYDEV_BCLK__SYSCLK__HZ          24000000u
+#define CY_SYS_SYST_NUM_OF_CALLBACKS    5u
+typedef void (*cySysTickCallback)(void);
+void  CySysTickStart(void);
+void  CySysTickSetReload(uint32 value);
+uint32 CySysTickGetReload(void);
+void  CySysTickClear(void);
+uint32 CySysTickGetValue(void);
+uint32 CySysTickGetCountFlag(void);
+cySysTickCallback CySysTickSetCallback(uint32 number, cySysTickCallback function);
+
+// Cycle counter of the profiler (prof.h) in place of the DWT: the node's run time on the host in ns
+uint32 hal_cycles(void);
+#define PROF_CYCLES()       hal_cycles()
+#define PROF_CYCLES_START() do { } while (0)
+#define PROF_CYCLES_PER_US  1000u
+
+// EEPROM (cy_boot CyFlash.h and CySpc.h): 2KB of 16 byte rows, read memory mapped and written a row at a
+// time by the SPC. A row write takes HAL_EEPROM_ROW_US, the node keeps running meanwhile.
+typedef uint32 cystatus;
+#define CYRET_SUCCESS           0x00u
+#define CYRET_STARTED           0x07u
+#define CY_EEPROM_SIZEOF_ROW    16u
+#define CY_EEPROM_NUMBER_ROWS   128u
+#define CY_EEPROM_SIZE          (CY_EEPROM_SIZEOF_ROW * CY_EEPROM_NUMBER_ROWS)
+#define CY_EEPROM_BASE          ((uintptr_t) hal_eeprom())
+#define CY_SPC_FIRST_EE_ARRAYID 0x40u
+#define CY_SPC_STATUS_SUCCESS   0x00u
+#define CY_SPC_READ_STATUS      hal_spc_status()
+#define CY_SPC_IDLE             hal_spc_idle()
+#define CY_SPC_BUSY             (!hal_spc_idle())
+extern uint8 dieTemperature[2];
+uint8   *hal_eeprom(void);
+uint8    hal_spc_idle(void);
+uint8    hal_spc_status(void);
+void     CyEEPROM_Start(void);
+cystatus CySetTemp(void);
+cystatus CySpcLock(void);
+void     CySpcUnlock(void);
+cystatus CySpcLoadRow(uint8 array, const uint8 buffer[], uint16 size);
+cystatus CySpcWriteRow(uint8 array, uint16 row, uint8 tempPolarity, uint8 tempMagnitude);
+
+// Timer: 32 bit down counter clocked at 1kHz
+void   Timer_Start(void);
+uint32 Timer_ReadCounter(void);
+uint32 Timer_ReadPeriod(void);
+
+// UART: RS485, 9 bit mark/space addressing, hardware address detect to buffer
+#define UART_RX_BUFFER_SIZE     64u
+#define UART_RX_HW_ADDRESS1     FOL_NODE_ADDRESS
+#define UART_RX_HW_ADDRESS2     0u      // as the schematic leaves it, rs485_rx_init sets BROADCAST_ADDRESS
+#define UART_SET_SPACE          0x00u
+#define UART_SET_MARK           0x01u
+void  hal_uart_start(void (*rx_isr)(void));
+#ifdef UART_RXISR_EXIT_CALLBACK
+#define UART_Start()    hal_uart_start(UART_RXISR_ExitCallback)
+#else
+#define UART_Start()    hal_uart_start(0)
+#endif
+void  UART_ClearRxBuffer(void);
+uint8 UART_GetRxBufferSize(void);
+uint8 UART_ReadRxData(void);
+void  UART_PutArray(const uint8 string[], uint8 byteCount);
+void  UART_SetTxAddressMode(uint8 addressMode);
+void  UART_SetRxAddress2(uint8 address);
+
+// Sticky status registers latching the fan tach edges, 8 fans each
+uint8 Status_Reg_1_Read(void);
+uint8 Status_Reg_2_Read(void);
+uint8 Status_Reg_3_Read(void);
+uint8 Status_Reg_4_Read(void);
+
+// SPI master and chip selects for the MCP23S17 GPIO expanders, 4 byte TX FIFO, interrupt on SPI done
+#define SPIM_GPIOX_STS_SPI_DONE 0x01u
+void  hal_spim_start(void (*tx_isr)(void));
+#ifdef SPIM_GPIOX_TX_ISR_EXIT_CALLBACK
+#define SPIM_GPIOX_Start()  hal_spim_start(SPIM_GPIOX_TX_ISR_ExitCallback)
+#else
+#define SPIM_GPIOX_Start()  hal_spim_start(0)
+#endif
+void  SPIM_GPIOX_WriteByte(uint8 txDataByte);
+uint8 SPIM_GPIOX_ReadTxStatus(void);
+void  nCS_GPIOXA_Write(uint8 value);
+void  nCS_GPIOXB_Write(uint8 value);
@@ -0,0 +1,282 @@
+// Decodes, profiles and replays event traces (trace.h) dumped from the wall,
+// with the debugger or host/sim -T.
+//
+//   replay [-d] [-l us] trace.bin...
+//
+// -d  print every event
+// -l  list master round trips at least this long (default TRACE_SLOW_US) and every timeout
+//
+// For every trace it prints the events by type, the master's round trips and
+// timeouts per cell and the cells' fan validations. The master's generations
+// are replayed: the grid it stepped from (TRACE_GRID) is stepped again with
+// this build's Life engine and must hash to what the master got (TRACE_STEP),
+// and the cell states rebuilt from the traced responses with the protocol code
+// (rs485.h) must match the grid it read. Build with the same WALL and FW as the
+// wall (make clean first).
+#include "project.h"
+#include "../conway.h"
+#include "../rs485.h"
+#include "../trace.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int      dump = 0;
+static uint32_t slow_us = TRACE_SLOW_US;
+
+static const char *type_names[] = {"?", "tx", "rx", "timeout", "fans", "val_start", "val_end", "step", "grid", "warm"};
+static const char *reason_names[] = {"reached", "expired", "stopped", "pushed"};
+
+typedef struct {
+    uint32_t count;
+    uint32_t slow;
+    uint32_t timeouts;
+    uint64_t rtt_sum;
+    uint32_t rtt_max;
+} cell_profile_t;
+
+// Time of every event in us since the first one. The ms count places events, the SysTick count gives the us
+// in between when it wraps slower than the ms can tell apart (the master), cells get ms resolution.
+static void event_times(const trace_log_t *log, const trace_entry_t *events, uint32_t n, double *t_us) {
+    double wrap_us = ((double) log->tick_reload + 1) / log->cycles_per_us;
+    t_us[0] = 0;
+    for (uint32_t i = 1; i < n; i++) {
+        const trace_entry_t *prev = &events[i - 1], *e = &events[i];
+        uint32_t d_ms = e->ms - prev->ms;
+        if (log->timer_period != UINT32_MAX && e->ms < prev->ms) d_ms = e->ms + (log->timer_period + 1 - prev->ms);
+        double d_us = d_ms * 1000.0;
+        if (wrap_us >= 4000) {
+            uint32_t ticks = prev->tick >= e->tick ? prev->tick - e->tick : prev->tick + (log->tick_reload + 1 - e->tick);
+            double fine_us = (double) ticks / log->cycles_per_us;
+            double wraps = round((d_us - fine_us) / wrap_us);
+            d_us = fine_us + (wraps > 0 ? wraps : 0) * wrap_us;
+        }
+        t_us[i] = t_us[i - 1] + d_us;
+    }
+}
+
+static void print_event(double t_us, const trace_entry_t *e) {
+    const uint8_t *bytes = (const uint8_t *) e->data;
+    printf("%12.3f %-9s ", t_us / 1000, e->type < sizeof(type_names) / sizeof(type_names[0]) ? type_names[e->type] : "?");
+    switch (e->type) {
+    case TRACE_TX:
+    case TRACE_RX:
+        printf("addr %3u cmd %u flags 0x%02x len %u:", e->a, e->b & RS485_CMD_MASK, e->b & ~RS485_CMD_MASK, e->c);
+        for (uint32_t i = 0; i + 1 < e->c && i < sizeof(e->data); i++) printf(" %02x", bytes[i]);
+        if (e->type == TRACE_RX && e->aux) printf(" rtt_us %u", e->aux);
+        break;
+    case TRACE_TIMEOUT: printf("cell %u cmd %u got %u bytes", e->a, e->b & RS485_CMD_MASK, e->c); break;
+    case TRACE_FANS: printf("spinning 0x%08x", e->data[0]); break;
+    case TRACE_VAL_START: printf("ctrl 0x%08x switching 0x%08x", e->data[0], e->data[1]); break;
+    case TRACE_VAL_END: printf("fan %u %s", e->a, e->b < 4 ? reason_names[e->b] : "?"); break;
+    case TRACE_STEP: printf("hash/state 0x%08x population %u period %u action %u", e->data[0], e->aux, e->b, e->c); break;
+    case TRACE_GRID: printf("cell %u state 0x%08x", e->a, e->data[0]); break;
+    case TRACE_WARM: if (e->b) printf("snapshot %u from slot %u", e->data[0], e->a); else printf("cold"); break;
+    }
+    printf("\n");
+}
+
+// Protocol replay: the state a traced response leaves the master with, returns 0 if it carries none
+static uint8_t response_state(const trace_entry_t *e, uint32_t *state) {
+    uint8_t bytes[9] = {0};
+    bytes[0] = e->b;
+    memcpy(&bytes[1], e->data, sizeof(e->data));
+    uint8_t cmd = e->b & RS485_CMD_MASK;
+    if (cmd == UART_READ_CHANGES) {
+        uint8_t changed = (e->b >> RS485_BYTES_SHIFT) & RS485_ALL_BYTES;
+        *state = (*state & ~rs485_bytes_mask(changed)) | rs485_get_changes(&bytes[2], changed);
+        return 1;
+    }
+    if (cmd == UART_READ || cmd == UART_WRITE) {
+        *state = rs485_get_state(&bytes[1]);
+        return 1;
+    }
+    return 0;
+}
+
+static int replay(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "replay: can't open %s\n", path);
+        return 1;
+    }
+    static uint8_t buf[1 << 22];
+    size_t len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    trace_log_t *log = (trace_log_t *) buf;
+    size_t header = offsetof(trace_log_t, entries);
+    if (len < header || log->magic != TRACE_MAGIC || len < header + (size_t) log->size * sizeof(trace_entry_t)) {
+        fprintf(stderr, "replay: %s isn't a trace dump\n", path);
+        return 1;
+    }
+
+    // Unroll the ring, oldest first
+    uint32_t n = log->head < log->size ? log->head : log->size;
+    uint32_t first = log->head < log->size ? 0 : log->head % log->size;
+    trace_entry_t *events = malloc((n ? n : 1) * sizeof(trace_entry_t));
+    double *t_us = malloc((n ? n : 1) * sizeof(double));
+    for (uint32_t i = 0; i < n; i++) events[i] = log->entries[(first + i) % log->size];
+    if (n) event_times(log, events, n, t_us);
+
+    uint8_t is_master = log->node == MASTER_ADDRESS;
+    printf("%s: %s %u, %u events kept of %u, %.3f s\n", path, is_master ? "master" : "cell", log->node,
+           n, log->head, n ? (t_us[n - 1] - t_us[0]) / 1e6 : 0);
+
+    uint32_t by_type[sizeof(type_names) / sizeof(type_names[0])] = {0};
+    cell_profile_t cells[NUM_CELLS + 1] = {{0}};
+    uint32_t val_count[4] = {0};
+    double val_sum_ms[4] = {0}, val_max_ms[4] = {0};
+    double val_start[FANS_PER_CELL];
+    for (uint32_t i = 0; i < FANS_PER_CELL; i++) val_start[i] = -1;
+
+    // Generation replay
+    uint32_t grid_states[NUM_CELLS], read_states[NUM_CELLS];
+    uint64_t grid_cells = 0;        // cells in the TRACE_GRID group being collected
+    uint64_t known = 0;             // cells whose state the traced responses fully tell
+    uint64_t missed = 0;            // cells that timed out since the last grid
+    uint32_t steps = 0, matched = 0, diverged = 0, skipped = 0;
+    uint32_t checked_cells = 0, protocol_diverged = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        trace_entry_t *e = &events[i];
+        if (dump) print_event(t_us[i], e);
+        if (e->type < sizeof(by_type) / sizeof(by_type[0])) by_type[e->type]++;
+        uint32_t cell = e->a < NUM_CELLS ? e->a : NUM_CELLS;
+
+        if (e->type == TRACE_RX && is_master && e->a < NUM_CELLS) {
+            cells[cell].count++;
+            cells[cell].rtt_sum += e->aux;
+            if (e->aux > cells[cell].rtt_max) cells[cell].rtt_max = e->aux;
+            if (e->aux >= slow_us) {
+                cells[cell].slow++;
+                if (!dump) printf("  slow    %12.3f ms cell %u cmd %u rtt_us %u\n", t_us[i] / 1000, e->a, e->b & RS485_CMD_MASK, e->aux);
+            }
+            uint8_t cmd = e->b & RS485_CMD_MASK;
+            uint8_t full = cmd != UART_READ_CHANGES || ((e->b >> RS485_BYTES_SHIFT) & RS485_ALL_BYTES) == RS485_ALL_BYTES;
+            if (response_state(e, &read_states[e->a]) && full) known |= 1ull << e->a;
+        } else if (e->type == TRACE_TIMEOUT) {
+            cells[cell].timeouts++;
+            if (e->a < NUM_CELLS) missed |= 1ull << e->a;
+            if (!dump) printf("  timeout %12.3f ms cell %u cmd %u got %u bytes\n", t_us[i] / 1000, e->a, e->b & RS485_CMD_MASK, e->c);
+        } else if (e->type == TRACE_VAL_START) {
+            for (uint32_t fan = 0; fan < FANS_PER_CELL; fan++) {
+                if ((e->data[1] >> fan) & 1) val_start[fan] = t_us[i];
+            }
+        } else if (e->type == TRACE_VAL_END && e->a < FANS_PER_CELL && e->b < 4) {
+            if (val_start[e->a] >= 0) {
+                double ms = (t_us[i] - val_start[e->a]) / 1000;
+                val_count[e->b]++;
+                val_sum_ms[e->b] += ms;
+                if (ms > val_max_ms[e->b]) val_max_ms[e->b] = ms;
+            }
+            val_start[e->a] = -1;
+        } else if (e->type == TRACE_GRID && e->a < NUM_CELLS) {
+            grid_states[e->a] = e->data[0];
+            grid_cells |= 1ull << e->a;
+            // The protocol replay has to agree with the grid for cells it fully knows and that answered
+            if (((known & ~missed) >> e->a) & 1) {
+                checked_cells++;
+                if (read_states[e->a] != e->data[0]) {
+                    protocol_diverged++;
+                    printf("  protocol %11.3f ms cell %u rebuilt 0x%08x grid 0x%08x\n", t_us[i] / 1000, e->a, read_states[e->a], e->data[0]);
+                }
+            }
+            read_states[e->a] = e->data[0];     // synced from here on
+            known |= 1ull << e->a;
+        } else if (e->type == TRACE_STEP && is_master) {
+            if (grid_cells == ALL_CELLS_MASK) {
+                steps++;
+                if (e->b && e->c != 0) {
+                    skipped++;  // repeated and the stuck action changed the frame (STUCK_HOLD is 0)
+                } else {
+                    conway_frame_t curr, next;
+                    memset(curr, 0, sizeof(curr));
+                    for (uint32_t c = 0; c < NUM_CELLS; c++) conway_set_tile(curr, c, grid_states[c]);
+                    conway_step(next, curr);
+                    conway_packed_t packed;
+                    if (conway_pack(packed, next) == e->data[0]) {
+                        matched++;
+                    } else {
+                        diverged++;
+                        printf("  diverged %11.3f ms hash 0x%08x, replayed 0x%08x\n", t_us[i] / 1000, e->data[0], conway_pack(packed, next));
+                    }
+                }
+            }
+            grid_cells = 0;
+            missed = 0;
+        }
+    }
+
+    printf("  events:");
+    for (uint32_t type = 1; type < sizeof(by_type) / sizeof(by_type[0]); type++) {
+        if (by_type[type]) printf(" %s %u", type_names[type], by_type[type]);
+    }
+    printf("\n");
+    if (is_master) {
+        printf("  cell  traced_rsp  slow  timeouts  rtt_avg_us  rtt_max_us\n");
+        for (uint32_t c = 0; c <= NUM_CELLS; c++) {
+            cell_profile_t *p = &cells[c];
+            if (!p->count && !p->timeouts) continue;
+            char name[8];
+            snprintf(name, sizeof(name), c < NUM_CELLS ? "%u" : "bcst", c);
+            printf("  %4s  %10u  %4u  %8u  %10.0f  %10u\n", name, p->count, p->slow, p->timeouts,
+                   p->count ? (double) p->rtt_sum / p->count : 0, p->rtt_max);
+        }
+        printf("  generations replayed %u: matched %u diverged %u skipped %u (stuck action)\n", steps, matched, diverged, skipped);
+        printf("  cell states rebuilt from responses checked %u: diverged %u\n", checked_cells, protocol_diverged);
+    } else {
+        for (uint32_t r = 0; r < 4; r++) {
+            if (!val_count[r]) continue;
+            printf("  validations %-7s %4u avg_ms %7.1f max_ms %7.1f\n", reason_names[r], val_count[r], val_sum_ms[r] / val_count[r], val_max_ms[r]);
+        }
+    }
+    free(events);
+    free(t_us);
+    return diverged || protocol_diverged;
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "dl:")) != -1) {
+        switch (opt) {
+        case 'd': dump = 1; break;
+        case 'l': slow_us = (uint32_t) strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [-d] [-l us] trace.bin...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-d] [-l us] trace.bin...\n", argv[0]);
+        return 2;
+    }
+    int failed = 0;
+    for (int i = optind; i < argc; i++) failed |= replay(argv[i]);
+    return failed;
+}
+
+// ---------------------------------------------------------------------------
+// Hardware the firmware headers touch, replay doesn't run it
+
+uint8 CyEnterCriticalSection(void) { return 0; }
+void  CyExitCriticalSection(uint8 savedIntrStatus) { (void) savedIntrStatus; }
+void  CyDelayUs(uint16 microseconds) { (void) microseconds; }
+uint32 CySysTickGetValue(void) { return 0; }
+uint32 CySysTickGetReload(void) { return 0; }
+void  CySysTickSetReload(uint32 value) { (void) value; }
+void  CySysTickClear(void) { }
+uint32 CySysTickGetCountFlag(void) { return 0; }
+cySysTickCallback CySysTickSetCallback(uint32 number, cySysTickCallback function) { (void) number; (void) function; return 0; }
+uint32 hal_cycles(void) { return 0; }
+uint32 Timer_ReadCounter(void) { return 0; }
+uint32 Timer_ReadPeriod(void) { return 0; }
+void  UART_ClearRxBuffer(void) { }
+uint8 UART_GetRxBufferSize(void) { return 0; }
+uint8 UART_ReadRxData(void) { return 0; }
+void  UART_SetTxAddressMode(uint8 addressMode) { (void) addressMode; }
+void  UART_SetRxAddress2(uint8 address) { (void) address; }
+void  UART_PutArray(const uint8 string[], uint8 byteCount) { (void) string; (void) byteCount; }
@@ -0,0 +1,180 @@
+// Converts Life patterns into the firmware's pattern library (patterns.h).
+//
+//   rle2c file... > ../patterns.h
+//
+// Reads run length encoded (.rle) and Life 1.06 (.lif) files. Each pattern is
+// cropped to its live cells and stored one word per row, bit n = column n, so
+// patterns can be up to 32 columns wide. The pattern name is the file name.
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ROWS    256
+#define MAX_COLS    32
+
+struct pattern {
+    char     name[64];
+    char     comment[128];
+    uint32_t rows[MAX_ROWS];
+    int      num_rows;
+    int      num_cols;
+};
+
+static void fail(const char *path, const char *msg) {
+    fprintf(stderr, "rle2c: %s: %s\n", path, msg);
+    exit(1);
+}
+
+static void set_cell(struct pattern *p, const char *path, long row, long col) {
+    if (row < 0 || row >= MAX_ROWS || col < 0 || col >= MAX_COLS) fail(path, "pattern too large");
+    p->rows[row] |= (uint32_t) 1 << col;
+}
+
+// Crops the pattern to its live cells
+static void crop(struct pattern *p) {
+    int top = MAX_ROWS, bottom = -1, left = MAX_COLS, right = -1;
+    for (int row = 0; row < MAX_ROWS; row++) {
+        if (!p->rows[row]) continue;
+        if (top == MAX_ROWS) top = row;
+        bottom = row;
+        int lo = __builtin_ctz(p->rows[row]);
+        int hi = 31 - __builtin_clz(p->rows[row]);
+        if (lo < left) left = lo;
+        if (hi > right) right = hi;
+    }
+    if (bottom < 0) {
+        p->num_rows = p->num_cols = 0;
+        return;
+    }
+    p->num_rows = bottom - top + 1;
+    p->num_cols = right - left + 1;
+    for (int row = 0; row < p->num_rows; row++) p->rows[row] = p->rows[top + row] >> left;
+    for (int row = p->num_rows; row < MAX_ROWS; row++) p->rows[row] = 0;
+}
+
+// The first #C comment line goes with the table, both formats have them
+static void read_comment(struct pattern *p, const char *line) {
+    if ((line[1] == 'C' || line[1] == 'c') && p->comment[0] == 0) {
+        const char *text = line + 2;
+        while (*text == ' ') text++;
+        snprintf(p->comment, sizeof(p->comment), "%.*s", (int) strcspn(text, "\r\n"), text);
+    }
+}
+
+static void read_rle(struct pattern *p, const char *path, FILE *f) {
+    char line[1024];
+    int header = 0;
+    long row = 0, col = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            read_comment(p, line);
+            continue;
+        }
+        if (!header) {
+            if (line[0] == 'x') header = 1;  // x = m, y = n, rule = ... (sizes come from the cells)
+            continue;
+        }
+        long count = 0;
+        for (char *c = line; *c; c++) {
+            if (isdigit((unsigned char) *c)) {
+                count = count * 10 + (*c - '0');
+                continue;
+            }
+            long n = count ? count : 1;
+            count = 0;
+            if (*c == 'b') {
+                col += n;
+            } else if (*c == '$') {
+                row += n;
+                col = 0;
+            } else if (*c == '!') {
+                return;
+            } else if (isalpha((unsigned char) *c)) {
+                for (long i = 0; i < n; i++) set_cell(p, path, row, col++);
+            }
+        }
+    }
+    if (!header) fail(path, "missing RLE header");
+}
+
+static void read_life106(struct pattern *p, const char *path, FILE *f) {
+    static long cells[MAX_ROWS * MAX_COLS][2];
+    long num = 0, min_row = 0, min_col = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            read_comment(p, line);
+            continue;
+        }
+        long col, row;
+        if (sscanf(line, "%ld %ld", &col, &row) != 2) continue;
+        if (num == MAX_ROWS * MAX_COLS) fail(path, "pattern too large");
+        if (num == 0 || row < min_row) min_row = row;
+        if (num == 0 || col < min_col) min_col = col;
+        cells[num][0] = row;
+        cells[num][1] = col;
+        num++;
+    }
+    for (long i = 0; i < num; i++) set_cell(p, path, cells[i][0] - min_row, cells[i][1] - min_col);
+}
+
+static void read_pattern(struct pattern *p, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) fail(path, "can't open");
+
+    // Name from the file name, as a C identifier
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    size_t len = strcspn(base, ".");
+    if (len >= sizeof(p->name)) len = sizeof(p->name) - 1;
+    for (size_t i = 0; i < len; i++) {
+        p->name[i] = isalnum((unsigned char) base[i]) ? (char) tolower((unsigned char) base[i]) : '_';
+    }
+
+    char first[1024] = "";
+    if (fgets(first, sizeof(first), f) && strncmp(first, "#Life 1.06", 10) == 0) {
+        read_life106(p, path, f);
+    } else {
+        rewind(f);
+        read_rle(p, path, f);
+    }
+    fclose(f);
+    crop(p);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file... > patterns.h\n", argv[0]);
+        return 1;
+    }
+    int num = argc - 1;
+    struct pattern *patterns = calloc((size_t) num, sizeof(*patterns));
+
+    printf("// Generated by host/rle2c from patterns/, do not edit. Regenerate with make -C host patterns\n");
+    printf("#pragma once\n");
+    printf("// Included by conway.h. Each row is a word, bit n = column n.\n");
+    for (int i = 0; i < num; i++) {
+        struct pattern *p = &patterns[i];
+        read_pattern(p, argv[i + 1]);
+        printf("\n");
+        if (p->comment[0]) printf("// %s\n", p->comment);
+        printf("const uint32_t conway_%s_rows[] = {", p->name);
+        for (int row = 0; row < p->num_rows; row++) {
+            printf("%s0x%0*x", row ? ", " : "", (p->num_cols + 3) / 4, p->rows[row]);
+        }
+        if (p->num_rows == 0) printf("0");
+        printf("};\n");
+        printf("const conway_pattern_t conway_%s = {%d, %d, conway_%s_rows};\n",
+               p->name, p->num_rows, p->num_cols, p->name);
+    }
+
+    printf("\n// Every pattern above, in file order\n");
+    printf("const conway_pattern_t *const conway_patterns[] = {\n");
+    for (int i = 0; i < num; i++) printf("    &conway_%s,\n", patterns[i].name);
+    printf("};\n");
+    printf("#define CONWAY_NUM_PATTERNS %d\n", num);
+    free(patterns);
+    return 0;
+}
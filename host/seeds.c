@@ -0,0 +1,291 @@
+// Searches seed patterns for the wall on every core and prints the best as
+// pattern tables for conway.h (the format of patterns.h).
+//
+//   seeds [-t seconds] [-j threads] [-k best] [-b rows x cols] [-d density] [-g generations] [-s seed] [-o dir]
+//
+// -t  how long to search (default 10)
+// -j  threads (default every core)
+// -k  how many seeds to print (default 8)
+// -b  seed box, seeds are centered on the wall like conway_load does (default 6x6)
+// -d  fraction of the box alive in random seeds (default 0.4)
+// -g  generations a seed is followed for, longer lives count as this long (default 4096)
+// -s  random seed
+// -o  also write the seeds as .rle files into dir (e.g. ../patterns, then make patterns)
+//
+// Seeds are random or mutations (a few flipped cells) of the best a thread has
+// found so far. Each is run on the torus with the wall's own Life engine until
+// it repeats (Brent's cycle detection), then scored:
+//   lifetime (generations before it repeats)
+//   x how evenly it used the wall, half for no cell ever switching a fan, full for all of them
+//   + SCORE_PERIOD per generation of the final period (up to 15), if anything is left alive
+// Build for another wall with the WALL overrides of the sim (make clean first).
+#include "project.h"
+#define CONWAY_ENGINE   CONWAY_ENGINE_BITBOARD
+#include "../conway.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SEEDS_MAX_THREADS   256
+#define SEEDS_MAX_BEST      64
+#define SEEDS_MUTATE        2       // in 1 of this many seeds a thread mutates one of its best instead of a random one
+#define SCORE_PERIOD        8.0
+
+typedef struct {
+    uint32_t rows, cols;
+    uint32_t bits[NUM_ROWS];    // one word per row, bit n = column n
+    uint32_t lifetime;          // generations before it repeats
+    uint32_t period;            // 0 if it didn't repeat within the generation limit
+    uint32_t alive;             // cells alive at the end
+    double   balance;           // cells (tiles) that switched a fan / NUM_CELLS
+    double   score;
+} seed_t;
+
+typedef struct {
+    uint32_t seed_state;
+    uint64_t evaluated;
+    uint32_t num_best;
+    seed_t   best[SEEDS_MAX_BEST];
+} worker_t;
+
+static double   search_s = 10;
+static uint32_t num_best = 8;
+static uint32_t box_rows = 6, box_cols = 6;
+static double   density = 0.4;
+static uint32_t max_gens = 4096;
+static volatile int stop = 0;
+
+// xorshift32, one per thread
+static uint32_t next_rand(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Puts a seed in the middle of an empty frame, like conway_load
+static void place(conway_frame_t frame, const seed_t *seed) {
+    memset(frame, 0, sizeof(conway_frame_t));
+    uint32_t row0 = (NUM_ROWS - seed->rows) / 2;
+    uint32_t col0 = (NUM_COLS - seed->cols) / 2;
+    for (uint32_t row = 0; row < seed->rows; row++) {
+        conway_set_bits(frame, row0 + row, col0, seed->cols, seed->bits[row]);
+    }
+}
+
+static int same_frame(conway_frame_t a, conway_frame_t b) {
+    return memcmp(a, b, sizeof(conway_frame_t)) == 0;
+}
+
+static void step(conway_frame_t frame) {
+    conway_frame_t next;
+    conway_step(next, frame);
+    memcpy(frame, next, sizeof(conway_frame_t));
+}
+
+// Runs a seed until it repeats and scores it
+static void evaluate(seed_t *seed) {
+    conway_frame_t start, tortoise, hare, touched = {0};
+    place(start, seed);
+
+    // Brent: the hare runs ahead in growing powers of two until it meets the tortoise, that gives the period
+    memcpy(tortoise, start, sizeof(conway_frame_t));
+    memcpy(hare, start, sizeof(conway_frame_t));
+    uint32_t power = 1, period = 0, gens = 0;
+    for (;;) {
+        conway_frame_t prev;
+        memcpy(prev, hare, sizeof(conway_frame_t));
+        step(hare);
+        gens++;
+        period++;
+        for (uint32_t row = 0; row < NUM_ROWS; row++) touched[row] |= prev[row] ^ hare[row];
+        if (same_frame(tortoise, hare)) break;
+        if (gens >= 2 * max_gens) {
+            period = 0;
+            break;
+        }
+        if (period == power) {
+            memcpy(tortoise, hare, sizeof(conway_frame_t));
+            power *= 2;
+            period = 0;
+        }
+    }
+
+    // Then two runners a period apart meet where the cycle starts
+    uint32_t lifetime = max_gens;
+    if (period) {
+        memcpy(tortoise, start, sizeof(conway_frame_t));
+        memcpy(hare, start, sizeof(conway_frame_t));
+        for (uint32_t i = 0; i < period; i++) step(hare);
+        lifetime = 0;
+        while (!same_frame(tortoise, hare) && lifetime < max_gens) {
+            step(tortoise);
+            step(hare);
+            lifetime++;
+        }
+    }
+
+    uint32_t alive = 0;
+    conway_tiles_t tiles = 0;
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        alive += CONWAY_POPCOUNT(hare[row]);
+        tiles |= conway_row_tiles(touched[row], row / CELL_ROWS);
+    }
+    seed->lifetime = lifetime;
+    seed->period = period;
+    seed->alive = alive;
+    seed->balance = (double) __builtin_popcountll(tiles) / NUM_CELLS;
+    seed->score = lifetime * (0.5 + 0.5 * seed->balance);
+    if (alive && period) seed->score += SCORE_PERIOD * (period < 15 ? period : 15);
+}
+
+// Keeps the best seeds of a thread, best first
+static void keep(worker_t *w, const seed_t *seed) {
+    if (w->num_best == num_best && seed->score <= w->best[num_best - 1].score) return;
+    uint32_t at = w->num_best;
+    for (uint32_t i = 0; i < w->num_best; i++) {
+        // mutants often run into the same history, those count once
+        if (w->best[i].lifetime == seed->lifetime && w->best[i].period == seed->period && w->best[i].alive == seed->alive) return;
+        if (at == w->num_best && seed->score > w->best[i].score) at = i;
+    }
+    if (w->num_best < num_best) w->num_best++;
+    memmove(&w->best[at + 1], &w->best[at], (w->num_best - 1 - at) * sizeof(seed_t));
+    w->best[at] = *seed;
+}
+
+static void *search(void *arg) {
+    worker_t *w = arg;
+    while (!stop) {
+        seed_t seed = {.rows = box_rows, .cols = box_cols};
+        if (w->num_best && next_rand(&w->seed_state) % SEEDS_MUTATE == 0) {
+            // flip 1 to 3 cells of one of the best
+            seed = w->best[next_rand(&w->seed_state) % w->num_best];
+            uint32_t flips = 1 + next_rand(&w->seed_state) % 3;
+            for (uint32_t i = 0; i < flips; i++) {
+                uint32_t n = next_rand(&w->seed_state) % (box_rows * box_cols);
+                seed.bits[n / box_cols] ^= 1u << (n % box_cols);
+            }
+        } else {
+            uint32_t threshold = (uint32_t) (density * 4294967295.0);
+            for (uint32_t row = 0; row < box_rows; row++) {
+                for (uint32_t col = 0; col < box_cols; col++) {
+                    if (next_rand(&w->seed_state) < threshold) seed.bits[row] |= 1u << col;
+                }
+            }
+        }
+        evaluate(&seed);
+        keep(w, &seed);
+        w->evaluated++;
+    }
+    return NULL;
+}
+
+// Crops a seed to its live cells, the torus doesn't care where it is
+static void crop(seed_t *seed) {
+    uint32_t top = seed->rows, bottom = 0, left = 32, right = 0;
+    for (uint32_t row = 0; row < seed->rows; row++) {
+        if (!seed->bits[row]) continue;
+        if (top == seed->rows) top = row;
+        bottom = row;
+        uint32_t lo = __builtin_ctz(seed->bits[row]), hi = 31 - __builtin_clz(seed->bits[row]);
+        if (lo < left) left = lo;
+        if (hi > right) right = hi;
+    }
+    if (top == seed->rows) {
+        seed->rows = seed->cols = 0;
+        return;
+    }
+    seed->rows = bottom - top + 1;
+    seed->cols = right - left + 1;
+    for (uint32_t row = 0; row < seed->rows; row++) seed->bits[row] = seed->bits[top + row] >> left;
+}
+
+static void write_rle(const char *dir, const char *name, const seed_t *seed) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.rle", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "seeds: can't write %s\n", path);
+        return;
+    }
+    fprintf(f, "#C Found by host/seeds on %ux%u: lives %u, period %u, score %.0f\n",
+            NUM_ROWS, NUM_COLS, seed->lifetime, seed->period, seed->score);
+    fprintf(f, "x = %u, y = %u, rule = B3/S23\n", seed->cols, seed->rows);
+    for (uint32_t row = 0; row < seed->rows; row++) {
+        for (uint32_t col = 0; col < seed->cols; col++) fputc((seed->bits[row] >> col) & 1 ? 'o' : 'b', f);
+        fputs(row + 1 < seed->rows ? "$\n" : "!\n", f);
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t rand_seed = (uint32_t) time(NULL);
+    const char *rle_dir = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:j:k:b:d:g:s:o:")) != -1) {
+        switch (opt) {
+        case 't': search_s = atof(optarg); break;
+        case 'j': threads = atol(optarg); break;
+        case 'k': num_best = (uint32_t) strtoul(optarg, NULL, 0); break;
+        case 'b': sscanf(optarg, "%ux%u", &box_rows, &box_cols); break;
+        case 'd': density = atof(optarg); break;
+        case 'g': max_gens = (uint32_t) strtoul(optarg, NULL, 0); break;
+        case 's': rand_seed = (uint32_t) strtoul(optarg, NULL, 0); break;
+        case 'o': rle_dir = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t seconds] [-j threads] [-k best] [-b rowsxcols] [-d density] "
+                            "[-g generations] [-s seed] [-o dir]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (threads > SEEDS_MAX_THREADS) threads = SEEDS_MAX_THREADS;
+    if (num_best < 1) num_best = 1;
+    if (num_best > SEEDS_MAX_BEST) num_best = SEEDS_MAX_BEST;
+    if (box_rows < 1 || box_rows > NUM_ROWS) box_rows = NUM_ROWS < 6 ? NUM_ROWS : 6;
+    if (box_cols < 1 || box_cols > NUM_COLS || box_cols > 32) box_cols = NUM_COLS < 6 ? NUM_COLS : 6;
+
+    static worker_t workers[SEEDS_MAX_THREADS];
+    pthread_t ids[SEEDS_MAX_THREADS];
+    for (long i = 0; i < threads; i++) {
+        workers[i].seed_state = rand_seed * 2654435761u + (uint32_t) i * 40503u + 1;
+        pthread_create(&ids[i], NULL, search, &workers[i]);
+    }
+    struct timespec wait = {(time_t) search_s, (long) ((search_s - (time_t) search_s) * 1e9)};
+    nanosleep(&wait, NULL);
+    stop = 1;
+
+    // Merge the threads' best
+    worker_t all = {0};
+    uint64_t evaluated = 0;
+    for (long i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+        evaluated += workers[i].evaluated;
+        for (uint32_t b = 0; b < workers[i].num_best; b++) keep(&all, &workers[i].best[b]);
+    }
+
+    printf("// Found by host/seeds on the %ux%u wall: %llu seeds in %.0fs on %ld threads (%.0f per minute)\n",
+           NUM_ROWS, NUM_COLS, (unsigned long long) evaluated, search_s, threads, evaluated * 60.0 / search_s);
+    for (uint32_t b = 0; b < all.num_best; b++) {
+        seed_t *seed = &all.best[b];
+        crop(seed);
+        char name[32];
+        snprintf(name, sizeof(name), "seed%u", b + 1);
+        printf("\n// lives %u, period %u, %u alive at the end, %.0f%% of cells used, score %.0f\n",
+               seed->lifetime, seed->period, seed->alive, 100 * seed->balance, seed->score);
+        printf("const uint32_t conway_%s_rows[] = {", name);
+        for (uint32_t row = 0; row < seed->rows; row++) {
+            printf("%s0x%0*x", row ? ", " : "", (seed->cols + 3) / 4, seed->bits[row]);
+        }
+        if (seed->rows == 0) printf("0");
+        printf("};\n");
+        printf("const conway_pattern_t conway_%s = {%u, %u, conway_%s_rows};\n", name, seed->rows, seed->cols, name);
+        if (rle_dir) write_rle(rle_dir, name, seed);
+    }
+    return 0;
+}
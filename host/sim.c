@@ -0,0 +1,214 @@
+// Runs the master and every cell of the wall in one process on virtual time.
+//
+//   sim [-t seconds] [-r touches_per_minute] [-s seed] [-p ms] [-b fans] [-v] [-g] [-S] [-P] [-T dir] [-E dir]
+//
+// -t  virtual time to run for (default 60)
+// -r  random human input: flicks and holds on random fans
+// -s  seed for the random input
+// -p  flick every fan this long after the cell switched it off (pushing a coasting fan)
+// -b  flick this many random fans at once SIM_BURST_US in, a seed for Life to run from. With -r 0 the wall
+//     then steps on its own, so builds can be compared by their -g walls (make check).
+// -v  print the wall every time the commanded fan states change
+// -g  print the wall once it held for SIM_SETTLE_US, one per generation (no cells caught switching)
+// -S  print the last bus telemetry report of every node
+// -P  print every node's profiler spans (prof.h), needs a build with FW="-DPROF_ENABLE=1"
+// -T  dump every node's event trace (trace.h) into dir as trace_<address>.bin, for host/replay
+// -E  keep every node's EEPROM in dir as eeprom_<address>.bin: loaded at power up if there, saved at the end,
+//     so the next run is a warm start (warm.h)
+#include "sim.h"
+#include "../physical.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_STEP_US     10000   // how often the wall is sampled for changes
+#define SIM_BURST_US    1500000 // -b: after the master cleared the wall
+#define SIM_SETTLE_US   500000  // -g: well under GEN_DWELL_MS
+
+struct sim_node_entry {
+    uint8_t     addr;
+    int         is_master;
+    sim_entry_t entry;
+    const uint8_t *trace;   // the node's trace_log, 0 without TRACE_ENABLE
+    const uint8_t *prof;    // the node's prof_log, 0 without PROF_ENABLE
+};
+
+// Generated by the Makefile from the node list
+extern const struct sim_node_entry sim_nodes[];
+extern const int sim_num_nodes;
+
+static void print_wall(uint64_t t_us) {
+    printf("t=%.3fs\n", t_us / 1e6);
+    for (uint32_t row = 0; row < NUM_ROWS; row++) {
+        for (uint32_t col = 0; col < NUM_COLS; col++) {
+            uint32_t cell = (col / CELL_COLS) + GRID_CELL_COLS * (row / CELL_ROWS);
+            uint32_t fan = (row % CELL_ROWS) * CELL_COLS + (col % CELL_COLS);
+            uint32_t on = (sim_cell_outputs((uint8_t) cell) >> fan) & 1;
+            uint32_t spin = (sim_cell_spinning((uint8_t) cell) >> fan) & 1;
+            putchar(on ? '#' : (spin ? '+' : '.'));
+        }
+        putchar('\n');
+    }
+}
+
+// Writes a node's trace_log like a debugger memory dump, its size is its second word
+static void dump_trace(const char *dir, const struct sim_node_entry *node) {
+    if (!node->trace) {
+        printf("trace %u: no trace_log, build with FW=\"-DTRACE_ENABLE=1\"\n", node->addr);
+        return;
+    }
+    uint32_t bytes;
+    memcpy(&bytes, node->trace + 4, sizeof(bytes));
+    char path[512];
+    snprintf(path, sizeof(path), "%s/trace_%u.bin", dir, node->addr);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "sim: can't write %s\n", path);
+        return;
+    }
+    fwrite(node->trace, 1, bytes, f);
+    fclose(f);
+}
+
+// Loads (save = 0) or saves a node's EEPROM, a missing file leaves it erased
+static void eeprom_file(const char *dir, uint8_t addr, int save) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/eeprom_%u.bin", dir, addr);
+    FILE *f = fopen(path, save ? "wb" : "rb");
+    if (!f) {
+        if (save) fprintf(stderr, "sim: can't write %s\n", path);
+        return;
+    }
+    if (save) fwrite(sim_eeprom(addr), 1, SIM_EEPROM_SIZE, f);
+    else if (fread(sim_eeprom(addr), 1, SIM_EEPROM_SIZE, f) != SIM_EEPROM_SIZE) fprintf(stderr, "sim: short %s\n", path);
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    double seconds = 60;
+    double touch_rate = 0;
+    unsigned seed = 1;
+    uint32_t push_ms = 0;
+    int burst = 0;
+    int verbose = 0;
+    int generations = 0;
+    int telemetry = 0;
+    int profile = 0;
+    const char *trace_dir = NULL;
+    const char *eeprom_dir = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:r:s:p:b:vgSPT:E:")) != -1) {
+        switch (opt) {
+        case 't': seconds = atof(optarg); break;
+        case 'r': touch_rate = atof(optarg); break;
+        case 's': seed = (unsigned) strtoul(optarg, NULL, 0); break;
+        case 'p': push_ms = (uint32_t) strtoul(optarg, NULL, 0); break;
+        case 'b': burst = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        case 'g': generations = 1; break;
+        case 'S': telemetry = 1; break;
+        case 'P': profile = 1; break;
+        case 'T': trace_dir = optarg; break;
+        case 'E': eeprom_dir = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-t seconds] [-r touches_per_minute] [-s seed] [-p ms] [-b fans] [-v] [-g] [-S] [-P] [-T dir] [-E dir]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    uint64_t end_us = (uint64_t) (seconds * 1e6);
+
+    for (int i = 0; i < sim_num_nodes; i++) {
+        sim_add_node(sim_nodes[i].addr, sim_nodes[i].is_master, sim_nodes[i].entry);
+        if (eeprom_dir) eeprom_file(eeprom_dir, sim_nodes[i].addr, 0);
+    }
+
+    sim_push_coasting(push_ms);
+    srand(seed);
+    int num_touches = (int) (touch_rate * seconds / 60);
+    for (int i = 0; i < num_touches; i++) {
+        uint64_t at = (uint64_t) ((double) rand() / RAND_MAX * end_us);
+        uint8_t cell = (uint8_t) (rand() % NUM_CELLS);
+        uint8_t fan = (uint8_t) (rand() % FANS_PER_CELL);
+        int kind = rand() % 2 ? SIM_TOUCH_SPIN : SIM_TOUCH_HOLD;
+        sim_touch(cell, fan, kind, at, 1000 + (uint32_t) (rand() % 2000));
+    }
+    for (int i = 0; i < burst; i++) {
+        uint8_t cell = (uint8_t) (rand() % NUM_CELLS);
+        sim_touch(cell, (uint8_t) (rand() % FANS_PER_CELL), SIM_TOUCH_SPIN, SIM_BURST_US, 0);
+    }
+
+    struct timespec wall_start, wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    uint32_t last_outputs[NUM_CELLS] = {0};
+    uint32_t updates = 0;
+    uint64_t first_update = 0, last_update = 0;
+    int settled = 1;    // the wall held since the last update
+    for (uint64_t t = SIM_STEP_US; t <= end_us; t += SIM_STEP_US) {
+        sim_run(t);
+        int changed = 0;
+        for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
+            uint32_t out = sim_cell_outputs((uint8_t) cell);
+            if (out != last_outputs[cell]) changed = 1;
+            last_outputs[cell] = out;
+        }
+        if (changed) {
+            if (updates == 0) first_update = t;
+            last_update = t;
+            updates++;
+            settled = 0;
+            if (verbose) print_wall(t);
+        } else if (!settled && t - last_update >= SIM_SETTLE_US) {
+            settled = 1;
+            if (generations) print_wall(last_update);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    double wall_s = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+
+    const struct sim_stats *s = sim_get_stats();
+    printf("virtual_s %.3f wall_s %.3f speedup %.0f\n", seconds, wall_s, wall_s > 0 ? seconds / wall_s : 0);
+    printf("touches %d\n", num_touches);
+    printf("bus_bytes %llu utilization %.2f%% contention %llu rx_overflow %llu\n",
+           (unsigned long long) s->bytes, 100.0 * s->busy_us / end_us,
+           (unsigned long long) s->contention, (unsigned long long) s->rx_overflow);
+    printf("packets");
+    for (int cmd = 0; cmd < 256; cmd++) {
+        if (s->packets[cmd]) printf(" cmd%d=%llu", cmd, (unsigned long long) s->packets[cmd]);
+    }
+    printf("\n");
+    printf("requests %llu responses %llu unanswered %llu\n", (unsigned long long) s->requests,
+           (unsigned long long) s->responses, (unsigned long long) s->unanswered);
+    if (s->rsp_samples) {
+        printf("rsp_ms avg %.2f min %.2f max %.2f\n", s->rsp_us_sum / 1e3 / s->rsp_samples,
+               s->rsp_us_min / 1e3, s->rsp_us_max / 1e3);
+    }
+    printf("input_changes %llu switched %llu", (unsigned long long) s->touches, (unsigned long long) s->input_samples);
+    if (s->input_samples) {
+        printf(" latency_ms avg %.1f max %.1f", s->input_us_sum / 1e3 / s->input_samples, s->input_us_max / 1e3);
+    }
+    printf("\n");
+    printf("wall_updates %u", updates);
+    if (updates) printf(" first_s %.2f", first_update / 1e6);
+    if (updates > 1) printf(" mean_interval_s %.2f", (last_update - first_update) / 1e6 / (updates - 1));
+    printf("\n");
+    if (telemetry) telemetry_print();
+    if (profile) {
+        for (int i = 0; i < sim_num_nodes; i++) {
+            if (sim_nodes[i].prof) telemetry_print_prof_log(sim_nodes[i].prof);
+            else printf("profile %u: no prof_log, build with FW=\"-DPROF_ENABLE=1\"\n", sim_nodes[i].addr);
+        }
+    }
+    if (trace_dir) {
+        for (int i = 0; i < sim_num_nodes; i++) dump_trace(trace_dir, &sim_nodes[i]);
+    }
+    if (eeprom_dir) {
+        for (int i = 0; i < sim_num_nodes; i++) eeprom_file(eeprom_dir, sim_nodes[i].addr, 1);
+    }
+    return 0;
+}
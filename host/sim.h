@@ -0,0 +1,49 @@
+#pragma once
+// Virtual wall: nodes, RS485 bus, GPIO expanders and fans on virtual time.
+#include <stdint.h>
+
+#define SIM_MAX_NODES       65  // master and up to 64 cells
+#define SIM_FANS_PER_CELL   32
+#define SIM_EEPROM_SIZE     2048    // CY_EEPROM_SIZE
+
+#define SIM_TOUCH_SPIN      0   // hand flicks a fan up to speed
+#define SIM_TOUCH_HOLD      1   // hand holds a fan stopped
+
+typedef int (*sim_entry_t)(void);
+
+// Bus statistics collected by watching the wire
+struct sim_stats {
+    uint64_t bytes;                 // bytes put on the bus
+    uint64_t busy_us;               // time the bus was driven
+    uint64_t contention;            // transmissions that had to wait for the bus
+    uint64_t packets[256];          // packets by command byte
+    uint64_t requests;              // master -> cell packets
+    uint64_t responses;             // cell -> master packets
+    uint64_t unanswered;            // requests superseded before a response came back
+    uint64_t rsp_samples;           // responses matched to a request
+    uint64_t rsp_us_sum;            // request end -> response end
+    uint64_t rsp_us_min;
+    uint64_t rsp_us_max;
+    uint64_t rx_overflow;           // bytes dropped by full RX buffers
+    uint64_t touches;               // touches that asked for a change (spin an off fan, hold an on one)
+    uint64_t input_samples;         // of those, followed by the cell switching the fan
+    uint64_t input_us_sum;          // touch -> fan output switched
+    uint64_t input_us_max;
+};
+
+void     sim_add_node(uint8_t addr, int is_master, sim_entry_t entry);
+void     sim_run(uint64_t until_us);
+uint64_t sim_now_us(void);
+
+void     sim_touch(uint8_t cell, uint8_t fan, int kind, uint64_t at_us, uint32_t hold_ms);
+void     sim_push_coasting(uint32_t after_ms);   // flick every fan this long after it is switched off, 0 = off
+uint32_t sim_cell_outputs(uint8_t cell);
+uint32_t sim_cell_spinning(uint8_t cell);
+uint8_t *sim_eeprom(uint8_t addr);         // a node's EEPROM, SIM_EEPROM_SIZE bytes, NULL for an unknown node
+
+const struct sim_stats *sim_get_stats(void);
+
+// Bus telemetry reports (telemetry.c)
+void     telemetry_observe(const uint8_t *data, uint8_t len);
+void     telemetry_print(void);
+void     telemetry_print_prof_log(const uint8_t *log);
@@ -0,0 +1,80 @@
+// Decodes the master's bus telemetry reports (see ../stats.h) off the wire.
+// hal.c hands over every packet on the bus, the latest report
+// of each node is kept and printed at the end of a run (sim -S).
+// Profiler spans (../prof.h, built with PROF_ENABLE) are taken off the wire
+// too, the cells' answers to the master as well as the master's own reports.
+#include "project.h"
+#include "sim.h"
+#include "../rs485.h"
+
+#include <stdio.h>
+
+static uint32_t reports[SIM_MAX_NODES][STATS_NUM];
+static int      reported[SIM_MAX_NODES];
+static uint32_t num_reports;
+
+static uint32_t prof_reports[SIM_MAX_NODES][PROF_NUM][PROF_COUNTERS];
+static int      prof_reported[SIM_MAX_NODES];
+
+static const char *prof_names[PROF_NUM] = {
+    "loop", "tick_latency", "tach_isr", "pwm_isr", "gpiox_send", "rs485_tx", "rx_isr", "step",
+};
+
+// Prints a node's profiler spans, times in us
+static void print_prof(int node, const uint32_t span[PROF_NUM][PROF_COUNTERS], uint32_t cycles_per_us) {
+    if (node == MASTER_ADDRESS) printf("profile master\n");
+    else printf("profile cell %d\n", node);
+    printf("  span            count     min_us    mean_us     max_us hist(<%d<<%dn cycles)\n", PROF_HIST_MIN, PROF_HIST_SHIFT);
+    for (int s = 0; s < PROF_NUM; s++) {
+        const uint32_t *c = span[s];
+        if (c[PROF_COUNT] == 0) continue;
+        double total = (double) (((uint64_t) c[PROF_TOTAL_HI] << 32) | c[PROF_TOTAL_LO]);
+        printf("  %-12s %8u %10.2f %10.2f %10.2f ", prof_names[s], c[PROF_COUNT], (double) c[PROF_MIN] / cycles_per_us,
+               total / c[PROF_COUNT] / cycles_per_us, (double) c[PROF_MAX] / cycles_per_us);
+        for (int b = 0; b < PROF_BUCKETS; b++) printf("%s%u", b ? "/" : "", c[PROF_HIST + b]);
+        printf("\n");
+    }
+}
+
+void telemetry_observe(const uint8_t *data, uint8_t len) {
+    if (len == 1 + RS485_PROF_SIZE && data[1] == (UART_STATS | RS485_PROF)) {
+        uint8_t node = data[2], span = data[3];
+        if (node >= SIM_MAX_NODES || span >= PROF_NUM) return;
+        stats_get(prof_reports[node][span], &data[4], PROF_COUNTERS);
+        prof_reported[node] = 1;
+        return;
+    }
+    if (len < 3 + 4 * STATS_NUM || data[0] != RS485_MONITOR_ADDRESS || data[1] != UART_STATS) return;
+    uint8_t cell = data[2];
+    if (cell >= SIM_MAX_NODES) return;
+    stats_get(reports[cell], &data[3], STATS_NUM);
+    reported[cell] = 1;
+    num_reports++;
+}
+
+void telemetry_print(void) {
+    printf("telemetry reports %u\n", num_reports);
+    printf("  cell  packets rx_tout rx_part resyncs loop_max_us | requests timeouts rsp_part rtt_max_us rtt_hist(<%d<<n)\n",
+           STATS_RTT_MIN_US);
+    for (int cell = 0; cell < SIM_MAX_NODES; cell++) {
+        if (!reported[cell]) continue;
+        const uint32_t *c = reports[cell];
+        if (cell == MASTER_ADDRESS) printf("  master");
+        else printf("  %4d", cell);
+        printf(" %8u %7u %7u %7u %11u | %8u %8u %8u %10u ", c[STAT_PACKETS], c[STAT_RX_TIMEOUTS],
+               c[STAT_RX_PARTIAL], c[STAT_RESYNCS], c[STAT_LOOP_MAX_US], c[STAT_REQUESTS],
+               c[STAT_TIMEOUTS], c[STAT_RSP_PARTIAL], c[STAT_RTT_MAX_US]);
+        for (int b = 0; b < STATS_RTT_BUCKETS; b++) printf("%s%u", b ? "/" : "", c[STAT_RTT_HIST + b]);
+        printf("\n");
+    }
+    for (int node = 0; node < SIM_MAX_NODES; node++) {
+        if (prof_reported[node]) print_prof(node, prof_reports[node], PROF_CYCLES_PER_US);
+    }
+}
+
+// Prints a node's prof_log (../prof.h) dumped from its memory
+void telemetry_print_prof_log(const uint8_t *log) {
+    const prof_log_t *p = (const prof_log_t *) log;
+    if (p->magic != PROF_MAGIC || p->spans != PROF_NUM || p->counters != PROF_COUNTERS) return;
+    print_prof((int) p->node, p->span, p->cycles_per_us);
+}
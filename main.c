@@ -1,26 +1,39 @@
 #include "conway.h"
 #include "fan.h"
+#include "halo.h"
 #include "master.h"
 #include "physical.h"
+#include "prof.h"
 #include "project.h"
+#include "pwm.h"
 #include "rs485.h"
+#include "scheduler.h"
+#include "slot.h"
+#include "stats.h"
 #include "stopwatch.h"
+#include "tach.h"
+#include "trace.h"
+#include "warm.h"
 
+// Role of this build, can also be set by the build (e.g. the host simulator)
+#if !(defined IS_SLAVE || defined IS_MASTER)
 //#define IS_SLAVE
 #define IS_MASTER
+#endif
 
 // Config error checking
 #if (defined IS_SLAVE && defined IS_MASTER)
 #error  Can not define both master and slave   
-#elif (defined IS_MASTER && UART_RX_HW_ADDRESS1 != 8)
+#elif (defined IS_MASTER && UART_RX_HW_ADDRESS1 != MASTER_ADDRESS)
 #error  incorrect master UART hardware address
-#elif (defined IS_SLAVE && UART_RX_HW_ADDRESS1 >= 8)
+#elif (defined IS_SLAVE && UART_RX_HW_ADDRESS1 >= NUM_CELLS)
 #error  incorrect slave UART hardware address
 #endif
 
 // Cell configuration bits
-#define CONFIG_PULSE_TIME   (1 << 0)    // enables/disables pulsing all fans on before a read operation
-#define CONFIG_PWM_FANS     (1 << 1)    // enables/disables PWMing fans that are on
+#define CONFIG_PULSE_TIME   (1 << 0)    // pulse length in ms, all fans on every PWM_PULSE_PERIOD_MS, 0 disables (pwm.h)
+#define CONFIG_PWM_FANS     (1 << 1)    // duty cycle of every fan that is on, out of 255, 0 is full speed
+#define CONFIG_FAN_SPEED    (1 << 2)    // duty cycle of one fan (byte 2, 0 to FANS_PER_CELL-1) out of 255 (byte 3)
 
 #define CONFIG_DEFAULT      0           // default cell config, no pulsing or pwm
 
@@ -33,136 +46,357 @@ int main(void) {
 
 
 #if (defined IS_SLAVE)
-    uint8_t rx_buff_size = 0;   // Stores UART RX buffer size
     uint32_t ctrl_state = 0;    // commanded state from master
     uint32_t old_state  = 0;    // previous state
     uint32_t curr_state = 0;    // current state
 
     uint32_t config = CONFIG_DEFAULT;
-    uint32_t cell_pulse_time_ms = 0;
-    uint32_t cell_pwm_time_ms = 0;
 
-    uint32_t timer_comm = 0;    // RS485 communication timer 
+    uint8_t  report_seq = RS485_SEQ_NONE;   // counts the changes reported to the master (UART_READ_CHANGES)
+    uint32_t report_state = 0;              // state as of report_seq
+
+    uint32_t stats[STATS_CELL_NUM] = {0};   // bus telemetry (stats.h)
+    uint32_t loop_start_us = 0;             // stopwatch_start_us at the start of the task
 
     uint32_t validation[FANS_PER_CELL] = {0};    // holds the validation times for each fan
+    warm_cell_t warm_cell;                  // snapshot for a warm start (warm.h)
 
+    prof_init(UART_RX_HW_ADDRESS1); // Profiler spans (PROF_ENABLE) from here on
     gpiox_init();   // Init GPIO expander ICs
-    curr_state = fan_set_state(0, TOUT_FAN_SET);     // Init fan states to 0
+    tach_init();    // Start sampling the fan tachs
+    pwm_init();     // Fans run at PWM_DEFAULT_LEVEL until configured
+    sched_init();   // Tasks run from here on, posted by the SysTick and UART interrupts
+    trace_init(UART_RX_HW_ADDRESS1);    // Once the SysTick runs
+    rs485_rx_init(1);   // Broadcasts
+    halo_init(UART_RX_HW_ADDRESS1);  // Find the neighbors for distributed Life
+    slot_init(UART_RX_HW_ADDRESS1);  // Slotted polls are answered in this cell's slot
+    if (warm_init(&warm_cell, sizeof(warm_cell))) {
+        // Warm start: back to the saved config and fans. Fans still turning from before the reset show up on the
+        // tach within TACH_STOP_MS, then the way to the saved state is validated in the background like a command.
+        for (uint32_t i = 0; i < FANS_PER_CELL; i++) pwm_set_level(i, warm_cell.levels[i]);
+        pwm_commit();
+        pwm_set_pulse(warm_cell.pulse_ms);
+        CyDelay(TACH_STOP_MS);
+        ctrl_state = warm_cell.state;
+        curr_state = fan_set_ctrl(fan_get_state(), ctrl_state, validation);
+    } else {
+        curr_state = fan_set_state(0, TOUT_FAN_SET);     // Init fan states to 0
+    }
 #elif (defined IS_MASTER)
-    CyDelay(1000);
-    master_write_all(0);
+    prof_init(MASTER_ADDRESS);  // Profiler spans (PROF_ENABLE) from here on
+    master_start();     // Bus transactions run from the UART RX interrupt
+    trace_init(MASTER_ADDRESS);
+    rs485_rx_init(CONWAY_DISTRIBUTED);  // Halos are broadcast, the master drains its RX buffer from the interrupt
+    // Distributed Life keeps the tiles on the cells, the master's snapshot only tells that the wall was running
+    warm_master_t warm_master;  // snapshot for a warm start (warm.h)
+    if (warm_init(&warm_master, sizeof(warm_master))) {
+        // Warm start: the cells are back on their own snapshots by now, the saved grid goes out on top
+        for (uint32_t cell = 0; cell < NUM_CELLS; cell++) conway_set_tile(conway_curr_frame, cell, warm_master.tiles[cell]);
+        CyDelay(WARM_BOOT_MS);
+#if !CONWAY_DISTRIBUTED
+        master_write_grid(conway_curr_frame, ALL_CELLS_MASK);
+#endif
+    } else {
+        CyDelay(1000);
+        master_write_all(0);
+    }
+#if CONWAY_DISTRIBUTED
+    master_halo_start();
+#else
+    master_read_grid_start();
+#endif
     
-#define CHANGE_TIMER_MS     6000
+#define CHANGE_TIMER_MS     6000    // steps anyway after this long, even if a cell isn't settled
+#define GEN_DWELL_MS        2000    // min time a generation (or human input) stays up before the next step
+
+// What to do once the wall repeats itself (still life or oscillator up to CONWAY_HISTORY)
+#define STUCK_HOLD          0       // stop stepping until human input, fans stay as they are
+#define STUCK_NOISE         1       // bring a random tile to life
+#define STUCK_RESEED        2       // start over from STUCK_PATTERN
+#ifndef STUCK_ACTION
+#define STUCK_ACTION        STUCK_HOLD
+#endif
+#define STUCK_PATTERN       (&conway_r_pentomino)
+    uint8_t stuck = 0;          // set while holding a stuck wall
+#if CONWAY_DISTRIBUTED
+    uint8_t stepped = 0;        // distributed Life: set until the halo round after a step is in
+#endif
     uint32_t timer_change = stopwatch_start();   // counts the time since human input
+    uint32_t timer_stats = stopwatch_start();    // counts the time since the last telemetry report
+    uint32_t loop_start_us = 0;                 // stopwatch_start_us at the start of the loop iteration
     //CyDelay(6000);
 #endif
 
     for(;;)
     {
 #ifdef IS_SLAVE
-        // Handle pulsing. Turns all fans on for cell_pulse_time_ms and then restores state.
-        // This is attempting to quiet the whining sound of the fans when off and trying to spin.
-        // Depending on length, may create an audible clicking sound or have no effect.
-        // NOTE: this doesn't really work :(
-        if (cell_pulse_time_ms) {
-            fan_set_state(UINT32_MAX, 0);
-            CyDelay(cell_pulse_time_ms);
-            fan_set_state(curr_state, 0);
-        }
-
-        // Handle PWMing. If enabled, turn on fan for cell_pwm_time_ms and then turn off.
-        // This lowers the fan speed for less force on fingers. Trade off is a small audible clicking sound.
-        if (cell_pwm_time_ms) {
-            fan_set_state(curr_state, 0);
-            CyDelay(cell_pwm_time_ms);
-            fan_set_state(0,0);
-        }
+        // Run the next ready task, sleeps until there is one (scheduler.h)
+        uint8_t task = sched_next();
+        loop_start_us = stopwatch_start_us();
+        PROF_BEGIN(PROF_LOOP);
 
-        // Handle updating fan state
-        old_state = curr_state;         // Save state
-        curr_state = fan_get_state();   // Get new state (200ms blocking time)
-
-        // Handle validation
-        for (uint32_t i = 0; i < FANS_PER_CELL; i++) {
-            if (validation[i]) {
-                if (curr_state & (1 << i)) {
-                    // fan still spinning, check if validation expired
-                    if (stopwatch_elapsed_ms(validation[i]) >= TOUT_FAN_SET) {
-                        // validation expired, reset
-                        validation[i] = 0;
+        if (task == SCHED_TASK_RX) {
+            // Check for commands, handle every full packet that is waiting
+            while (rs485_rx_poll()) {
+                uint8 rx_cmd = rs485_rx_packet[0];  // first byte is the command
+                rs485_trace(TRACE_RX, UART_RX_HW_ADDRESS1, rs485_rx_packet, rs485_rx_count, 0);
+                if (rx_cmd == UART_READ) {
+                    uint8_t settled = fan_settled() ? RS485_SETTLED : 0;
+                    rs485_tx(MASTER_ADDRESS, UART_READ | settled, curr_state);  // send back current state
+                } else if (rx_cmd == UART_READ_CHANGES) {
+                    // send back only the bytes that changed since the master's sequence, all if it missed a response
+                    uint8_t settled = fan_settled() ? RS485_SETTLED : 0;
+                    uint8_t bytes = RS485_ALL_BYTES;
+                    if (rs485_rx_packet[1] == report_seq) bytes = rs485_changed_bytes(curr_state ^ report_state);
+                    else stats[STAT_RESYNCS]++;
+                    if (bytes) {
+                        report_seq = rs485_next_seq(report_seq);
+                        report_state = curr_state;
+                    }
+                    rs485_tx_changes(UART_READ_CHANGES | settled, report_seq, curr_state, bytes);
+                } else if (rx_cmd == (UART_READ_CHANGES | RS485_SLOTTED)) {
+                    // broadcast, answered in this cell's slot like a UART_READ_CHANGES with the cell in place of the sequence
+                    if (slot_start(rs485_rx_timed, rs485_rx_at_us)) {
+                        uint8_t settled = fan_settled() ? RS485_SETTLED : 0;
+                        uint8_t bytes = RS485_ALL_BYTES;
+                        if (rs485_get_heard(rs485_rx_packet, UART_RX_HW_ADDRESS1)) bytes = rs485_changed_bytes(curr_state ^ report_state);
+                        else stats[STAT_RESYNCS]++;
+                        if (bytes) {
+                            report_seq = rs485_next_seq(report_seq);
+                            report_state = curr_state;
+                        }
+                        uint8_t answer[1 + RS485_RSP_MAX];
+                        slot_answer(answer, rs485_put_changes(answer, UART_READ_CHANGES | settled, UART_RX_HW_ADDRESS1, curr_state, bytes));
+                    }
+                } else if (rx_cmd == UART_WRITE) {
+                    // next 4 bytes are new state
+                    ctrl_state = rs485_get_state(&rs485_rx_packet[1]);
+                    halo_missed = 0;    // on the master's generation now
+                    uint8_t settled = fan_settled() ? RS485_SETTLED : 0;
+                    rs485_tx(MASTER_ADDRESS, UART_WRITE | settled, curr_state); // send back confirmation that cmd was received
+                    curr_state = fan_set_ctrl(curr_state, ctrl_state, validation);
+                    sched_post(SCHED_TASK_FANS);
+                } else if (rx_cmd == UART_WRITE_ALL) {
+                    // broadcast, take this cell's slice if it's in this segment and don't respond
+                    if (rs485_get_all_state(rs485_rx_packet, UART_RX_HW_ADDRESS1, &ctrl_state)) {
+                        halo_missed = 0;
+                        curr_state = fan_set_ctrl(curr_state, ctrl_state, validation);
+                        sched_post(SCHED_TASK_FANS);
+                    }
+                } else if (rx_cmd == UART_STATS) {
+                    rs485_tx_stats(stats);
+                } else if (rx_cmd == (UART_STATS | RS485_PROF)) {
+                    rs485_tx_prof(MASTER_ADDRESS, UART_RX_HW_ADDRESS1, (uint8_t) rs485_get_state(&rs485_rx_packet[1]));
+                } else if (rx_cmd == UART_STEP) {
+                    // distributed Life, broadcast
+                    if (rs485_rx_packet[1] == RS485_STEP_HALO) {
+                        halo_start();
                     } else {
-                        // still validating, don't recognize spindown as human input
-                        curr_state &= ~(1 << i);
+                        PROF_BEGIN(PROF_STEP);
+                        uint32_t next_state = halo_step(curr_state);
+                        PROF_END(PROF_STEP);
+                        curr_state = fan_set_ctrl(curr_state, next_state, validation);
+                        sched_post(SCHED_TASK_FANS);
+                    }
+                } else if ((rx_cmd & RS485_CMD_MASK) == UART_HALO) {
+                    // another cell's edges, broadcast, or resent by the master for a step this cell missed
+                    if (halo_receive(rs485_rx_packet)) {
+                        curr_state = fan_set_ctrl(curr_state, halo_catch_up(curr_state), validation);
+                        stats[STAT_RESYNCS]++;
+                        sched_post(SCHED_TASK_FANS);
+                    }
+                } else if (rx_cmd == UART_CONFIG) {
+                    uint8_t config_option = rs485_rx_packet[1]; // get type of config
+                    // Pulsing and PWM run from the SysTick interrupt (pwm.h)
+                    if (config_option == CONFIG_PULSE_TIME) {
+                        pwm_set_pulse(rs485_rx_packet[2]);
+                    } else if (config_option == CONFIG_PWM_FANS) {
+                        pwm_set_all(pwm_duty_level(rs485_rx_packet[2]));
+                    } else if (config_option == CONFIG_FAN_SPEED && rs485_rx_packet[2] < FANS_PER_CELL) {
+                        pwm_set_level(rs485_rx_packet[2], pwm_duty_level(rs485_rx_packet[3]));
+                        pwm_commit();
                     }
-                } else {
-                    // fan not spinning, reset validation
-                    validation[i] = 0;
                 }
+                // Packet handled, start on the next one
+                stats[STAT_PACKETS]++;
+                rs485_rx_clear();
+                sched_timer_stop(SCHED_TIMER_RX);
             }
-        }
+            // A halo round started or the cell before this one was heard
+            if (halo_due) sched_post(SCHED_TASK_HALO);
 
-        // Handle human input
-        if (curr_state != old_state) {
-            fan_set_state(curr_state, 0);  // don't validate since human input has no spindown
-        }
+            // If a packet is partially received, clear the buffer if it isn't done in time
+            if (rs485_rx_count != 0 || rs485_rx_waiting()) {
+                if (!sched_timer_armed(SCHED_TIMER_RX)) sched_timer_start(SCHED_TIMER_RX, SCHED_TASK_RX_TOUT, TOUT_RX_COMM);
+            } else {
+                sched_timer_stop(SCHED_TIMER_RX);
+            }
+        } else if (task == SCHED_TASK_HALO) {
+            // Send this cell's halo once it's its turn
+            halo_poll(curr_state, fan_settled() ? RS485_SETTLED : 0);
+            if (halo_due) sched_timer_start(SCHED_TIMER_HALO, SCHED_TASK_HALO, halo_wait_ms());
+        } else if (task == SCHED_TASK_FANS) {
+            // Handle updating fan state
+            old_state = curr_state;         // Save state
+            curr_state = fan_get_state();   // Get new state (sampled in the background)
 
-        // Check for commands
-        rx_buff_size = UART_GetRxBufferSize();
-        if (rx_buff_size == UART_RX_BUFFER_SIZE) {
-            uint8 rx_cmd = UART_ReadRxData();   // first byte is READ/WRITE
-            if (rx_cmd == UART_READ) {
-                rs485_tx(MASTER_ADDRESS, UART_READ, curr_state);    // send back current state
-            } else if (rx_cmd == UART_WRITE) {
-                // next 4 bytes are new state
-                ctrl_state  = ((uint32_t) UART_ReadRxData() << 24) |
-                              ((uint32_t) UART_ReadRxData() << 16) |
-                              ((uint32_t) UART_ReadRxData() <<  8) |
-                              ((uint32_t) UART_ReadRxData() <<  0);
-                rs485_tx(MASTER_ADDRESS, UART_WRITE, curr_state);   // send back confirmation that cmd was received
-                curr_state = fan_set_ctrl(curr_state, ctrl_state, validation);
-            } else if (rx_cmd == UART_CONFIG) {
-                uint8_t config_option =  UART_ReadRxData(); // get type of config
-                if (config_option == CONFIG_PULSE_TIME) {
-                    cell_pulse_time_ms = UART_ReadRxData();
-                } else if (config_option == CONFIG_PWM_FANS) {
-                    cell_pwm_time_ms = UART_ReadRxData();
+            // Handle validation, a fan that was just switched isn't human input until it had time to get there
+            for (uint32_t fans = fan_validating; fans; fans &= fans - 1) {
+                uint32_t i = __builtin_ctz(fans);
+                uint32_t fan = (1 << i);
+                if (old_state & fan) {
+                    // spinning up
+                    uint32_t elapsed_ms = stopwatch_elapsed_ms(validation[i]);
+                    if ((curr_state & fan) || elapsed_ms >= TOUT_FAN_SPINUP) {
+                        // fan got there or validation expired, reset
+                        trace_put(TRACE_VAL_END, i, (curr_state & fan) ? TRACE_VAL_REACHED : TRACE_VAL_EXPIRED, 0, 0, 0, 0);
+                        fan_validating &= ~fan;
+                        sched_timer_stop(i);
+                    } else {
+                        // still validating, don't recognize spinup as human input
+                        curr_state |= fan;
+                        sched_timer_start(i, SCHED_TASK_FANS, TOUT_FAN_SPINUP - elapsed_ms);
+                    }
+                } else {
+                    uint8_t coast = fan_coast_update(i);
+                    if (coast == FAN_COASTING) {
+                        // spinning down as expected, don't recognize spindown as human input
+                        curr_state &= ~fan;
+                    } else {
+                        // stopped, or pushed by a hand and still spinning (human input)
+                        trace_put(TRACE_VAL_END, i, coast == FAN_STOPPED ? TRACE_VAL_STOPPED : TRACE_VAL_PUSHED, 0, 0, 0, 0);
+                        fan_validating &= ~fan;
+                    }
                 }
             }
-            // Clear RX buffer after processing data
-            UART_ClearRxBuffer();
-            timer_comm = 0;
-        } else if (rx_buff_size != 0) {
-            // If buffer isn't full or empty, clear the buffer if a timeout occurs
-            if (timer_comm == 0) {
-                // Set timer if it hasn't been started yet
-                timer_comm = stopwatch_start();
-            } else {
-                if (stopwatch_elapsed_ms(timer_comm) >= TOUT_RX_COMM) {
-                    // Comm timeout: reset timer and clear RX buffer
-                    timer_comm = 0;
-                    UART_ClearRxBuffer();    
-                }
+            // Coasting fans are checked on every pulse
+            sched_watch = fan_validating;
+
+            // Handle human input
+            if (curr_state != old_state) {
+                fan_set_state(curr_state, 0);  // don't validate since human input has no spindown
+            }
+        } else if (task == SCHED_TASK_WARM) {
+            // Snapshot for a warm start, its rows are written in the background
+            if (warm_due()) {
+                warm_cell.state = curr_state;
+                warm_cell.pulse_ms = pwm_pulse_ticks * PWM_TICK_MS;
+                memcpy(warm_cell.levels, pwm_levels, sizeof(warm_cell.levels));
+                warm_save(&warm_cell);
+            }
+            sched_timer_start(SCHED_TIMER_WARM, SCHED_TASK_WARM, warm_poll() ? WARM_ROW_MS : WARM_PERIOD_MS);
+        } else if (task == SCHED_TASK_RX_TOUT) {
+            // Comm timeout: clear RX buffer
+            if (rs485_rx_count != 0 || rs485_rx_waiting()) {
+                stats[STAT_RX_TIMEOUTS]++;
+                if (rs485_rx_count != 0) stats[STAT_RX_PARTIAL]++;
+                rs485_rx_flush();
             }
         }
+
+        uint32_t loop_us = stopwatch_elapsed_us(loop_start_us);
+        if (loop_us > stats[STAT_LOOP_MAX_US]) stats[STAT_LOOP_MAX_US] = loop_us;
+        PROF_END(PROF_LOOP);
 #endif // SLAVE
 
 #ifdef IS_MASTER 
+        loop_start_us = stopwatch_start_us();
+        PROF_BEGIN(PROF_LOOP);
+
         // Play Conway's Game of Life
 
-        // Save last state
-        memcpy(conway_last_frame, conway_curr_frame, sizeof(conway_curr_frame));
-        // Read grid
-        master_read_grid(conway_curr_frame);
-        // Check if it's change        
-        if (conway_has_changed() >= 2) {
-            timer_change = stopwatch_start();    
+#if CONWAY_DISTRIBUTED
+        // The cells step their own tiles. Wait for the halo round to come back, the bus runs from interrupts meanwhile
+        if (master_halo_ready()) {
+            // Cells that missed the last step get its halos again and catch up, the round is run again after
+            uint8_t behind = master_halo_resync();
+            // A step that changed no tile is a still life, longer periods can't be seen from here
+            uint8_t still = stepped && !behind && master_halo_cells == ALL_CELLS_MASK && master_halo_changed == 0;
+            stepped = 0;
+            // Human input wakes up a held wall
+            if (master_halo_changed) {
+                timer_change = stopwatch_start();
+                stuck = 0;
+            }
+            if (still) {
+#if (STUCK_ACTION == STUCK_HOLD)
+                stuck = 1;
+#elif (STUCK_ACTION == STUCK_NOISE)
+                master_write_cell(conway_rand() % NUM_CELLS, conway_noise_tile());
+#elif (STUCK_ACTION == STUCK_RESEED)
+                conway_load(conway_curr_frame, STUCK_PATTERN);
+                master_write_grid(conway_curr_frame, ALL_CELLS_MASK);
+#endif
+                timer_change = stopwatch_start();   // the next step needs the halos of a round after this
+            }
+            // Step once all fans got to their states and the dwell time passed, or if the timer has expired.
+            // Only after a round every cell sent its halo in, else some cells would step and some not and the
+            // wall would split across generations: the round is run again instead.
+            uint32_t elapsed_ms = stopwatch_elapsed_ms(timer_change);
+            uint8_t complete = master_halo_cells == ALL_CELLS_MASK && !behind;
+            if (!stuck && complete && (master_halo_all_settled() ? elapsed_ms >= GEN_DWELL_MS : elapsed_ms >= CHANGE_TIMER_MS)) {
+                master_step();
+                stepped = 1;
+                timer_change = stopwatch_start();
+            }
+            // Next round goes out right behind the step
+            master_halo_start();
+        }
+#else
+        // Wait for the grid read to come back, the bus runs from interrupts meanwhile
+        if (master_read_grid_ready()) {
+            // Save last state
+            memcpy(conway_last_frame, conway_curr_frame, sizeof(conway_curr_frame));
+            // Read grid
+            master_read_grid_finish(conway_curr_frame);
+            // Human input wakes up the tiles it touched, and a held wall
+            conway_tiles_t input = conway_tiles_changed(conway_curr_frame, conway_last_frame);
+            conway_dirty |= input;
+            if (input) stuck = 0;
+            // Check if it's change        
+            if (conway_has_changed() >= 2) {
+                timer_change = stopwatch_start();    
+            }
+            // Update once all fans got to their states and the dwell time passed, or if the timer has expired
+            uint32_t elapsed_ms = stopwatch_elapsed_ms(timer_change);
+            if (!stuck && ((master_grid_settled() && elapsed_ms >= GEN_DWELL_MS) || elapsed_ms >= CHANGE_TIMER_MS)) {
+                master_trace_grid(conway_curr_frame);
+                PROF_BEGIN(PROF_STEP);
+                conway_update_frame();
+                PROF_END(PROF_STEP);
+                uint32_t period = conway_history_push(conway_curr_frame);
+                if (period) {
+#if (STUCK_ACTION == STUCK_HOLD)
+                    stuck = 1;
+#elif (STUCK_ACTION == STUCK_NOISE)
+                    conway_noise(conway_curr_frame);
+#elif (STUCK_ACTION == STUCK_RESEED)
+                    conway_load(conway_curr_frame, STUCK_PATTERN);
+#endif
+                }
+                master_trace_step(conway_curr_frame, period, STUCK_ACTION);
+                master_write_grid(conway_curr_frame, conway_dirty);   // only the cells that changed
+                timer_change = stopwatch_start();
+            }
+            // Next read goes out right behind the write
+            master_read_grid_start();
+        }
+#endif
+
+        // Snapshot for a warm start, its rows are written in the background
+        if (warm_due()) {
+            for (uint32_t cell = 0; cell < NUM_CELLS; cell++) warm_master.tiles[cell] = conway_get_tile(conway_curr_frame, cell);
+            warm_save(&warm_master);
         }
-        // Update only if timer has expired
-        if (stopwatch_elapsed_ms(timer_change) >= CHANGE_TIMER_MS) {
-            conway_update_frame();
-            master_write_grid(conway_curr_frame);
-            timer_change = stopwatch_start();
+        warm_poll();
+
+        // Bus telemetry for a monitor
+        if (stopwatch_elapsed_ms(timer_stats) >= STATS_PERIOD_MS) {
+            master_stats_report();
+            timer_stats = stopwatch_start();
         }
+        master_loop_done(loop_start_us);
+        PROF_END(PROF_LOOP);
 /*
         // Tests turning all fans on and off
         while(1) {
@@ -173,12 +407,12 @@ int main(void) {
         }
                
         // Tests conway wiht no human input
-        memcpy(conway_curr_frame, conway_dead, sizeof(conway_curr_frame));
-        master_write_grid(conway_curr_frame);
+        conway_load(conway_curr_frame, &conway_dead);
+        master_write_grid(conway_curr_frame, ALL_CELLS_MASK);
         CyDelay(6000);
         while(1) {
             conway_update_frame();
-            master_write_grid(conway_curr_frame);
+            master_write_grid(conway_curr_frame, ALL_CELLS_MASK);
             CyDelay(6000);
         }
 
@@ -1,88 +1,566 @@
+#include "conway.h"
 #include "physical.h"
+#include "prof.h"
 #include "project.h"
 #include "rs485.h"
+#include "stats.h"
 #include "stopwatch.h"
+#include "trace.h"
 
-uint8_t rx_timeout = 0;
+/*
+Bus transactions are queued and run back to back from the UART RX interrupt:
+when a response completes the ISR stores it and puts the next request on the
+bus, so the main loop is free while bytes are in flight. master_poll() must be
+called from the main loop to handle timeouts and report finished transactions.
+The bus turnaround after a response isn't waited out in the ISR, the next
+request goes out from master_poll() (or master_queue()) once it has passed.
+*/
+#define XFER_QUEUE_SIZE     (NUM_CELLS + 8) // max transactions queued or waiting to be reported (a grid read and a few more)
+#define XFER_TURNAROUND_US  100     // lets the cell release the bus before the next request
+#ifndef MASTER_POLL_SLOTTED
+#define MASTER_POLL_SLOTTED 1       // grid reads are one slotted poll (rs485.h), else one UART_READ_CHANGES per cell
+#endif
+#define XFER_SLOT_SLACK_MS  2       // slotted poll: time past the end of the last slot, counted from the last cell heard
 
-// Writes to a singe cell, blocks until response received
-void master_write_cell(uint32_t cell, uint32_t state) {
-    rs485_tx(cell, UART_WRITE, state);
-    uint32_t timer_confirmation = stopwatch_start();
-    while (UART_GetRxBufferSize() != UART_RX_BUFFER_SIZE) {
-        if (stopwatch_elapsed_ms(timer_confirmation) >= TOUT_SLV_RSP) break;   // timeout
+// Transaction status
+#define XFER_QUEUED     0   // waiting for the bus
+#define XFER_BUSY       1   // request sent, waiting for the response
+#define XFER_DONE       2   // response received (or broadcast sent)
+#define XFER_TIMEOUT    3   // no response within TOUT_SLV_RSP, or a slotted poll's last slot stayed quiet
+
+typedef struct master_xfer {
+    uint8_t  cell;
+    uint8_t  cmd;
+    uint8_t  flags;     // response flags (RS485_SETTLED)
+    volatile uint8_t status;
+    uint8_t  seq;       // UART_READ_CHANGES: sequence sent, replaced by the cell's
+    uint32_t changed;   // UART_READ_CHANGES: fans (bits) carried by the response, the rest of state is 0
+    uint32_t state;     // sent with the request, replaced by the response
+    uint32_t timer;     // started when the request went out
+    uint32_t start_us;  // stopwatch_start_us when the request went out, for the round trip
+    void (*done)(struct master_xfer *xfer); // called from master_poll once finished, may be 0
+} master_xfer_t;
+
+master_xfer_t master_xfers[XFER_QUEUE_SIZE];
+volatile uint8_t master_xfer_done = 0;  // oldest transaction not reported yet
+volatile uint8_t master_xfer_head = 0;  // transaction on the bus
+volatile uint8_t master_xfer_tail = 0;  // next free slot
+
+uint32_t master_bcast_states[NUM_CELLS];    // states sent by the queued UART_WRITE_ALL
+uint64_t master_bcast_cells = 0;            // cells the queued UART_WRITE_ALL has to reach
+
+uint32_t master_halo_edges[NUM_CELLS];      // distributed Life: edges heard in the halo round, per cell
+uint32_t master_halo_step_edges[NUM_CELLS]; // those of the round the last step used, resent by master_halo_resync
+
+uint8_t  master_turnaround = 0;     // set until XFER_TURNAROUND_US after the last transaction finished
+uint32_t master_turnaround_us;      // stopwatch_start_us when it finished
+
+uint8_t master_rsp[RS485_RSP_MAX];  // response being received
+uint8_t master_rsp_count = 0;
+
+uint32_t master_stats[NUM_CELLS + 1][STATS_NUM];   // telemetry per cell, the last row is the master's own (stats.h)
+
+// Slotted poll, cells whose last UART_READ_CHANGES response the master got, bit n = cell n (sent with the poll)
+uint64_t master_cell_heard = 0;
+uint64_t master_slot_cells = 0;             // cells that answered in their slot
+uint32_t master_slot_left = 0;              // slots after the last one heard
+uint32_t master_slot_states[NUM_CELLS];     // their responses, as in master_xfer_t
+uint32_t master_slot_changed[NUM_CELLS];
+uint8_t  master_slot_flags[NUM_CELLS];
+
+// Puts queued requests on the bus until one needs a response, once the bus turned around. Interrupts must be off.
+void master_xfer_start(void) {
+    if (master_turnaround) {
+        if (stopwatch_elapsed_us(master_turnaround_us) < XFER_TURNAROUND_US) return;
+        master_turnaround = 0;
+    }
+    while (master_xfer_head != master_xfer_tail) {
+        master_xfer_t *xfer = &master_xfers[master_xfer_head];
+        if (xfer->status == XFER_BUSY) return;  // already on the bus
+        if (xfer->cmd == UART_WRITE_ALL) {
+            rs485_tx_all(UART_WRITE_ALL, master_bcast_states, master_bcast_cells);
+            master_bcast_cells = 0;
+            xfer->status = XFER_DONE;   // broadcasts aren't answered
+            master_xfer_head = (master_xfer_head + 1) % XFER_QUEUE_SIZE;
+            continue;
+        }
+        if (xfer->cmd == UART_STEP && xfer->state == RS485_STEP_GO) {
+            rs485_tx_step(RS485_STEP_GO);
+            xfer->status = XFER_DONE;   // cells step without answering
+            master_xfer_head = (master_xfer_head + 1) % XFER_QUEUE_SIZE;
+            continue;
+        }
+        if (xfer->cmd == (UART_HALO | RS485_HALO_RESYNC)) {
+            rs485_tx_halo(xfer->cell, xfer->cmd, (uint8_t) xfer->state, master_halo_step_edges[xfer->state]);
+            xfer->status = XFER_DONE;   // the cell catches up without answering
+            master_xfer_head = (master_xfer_head + 1) % XFER_QUEUE_SIZE;
+            continue;
+        }
+        if (xfer->cell == RS485_MONITOR_ADDRESS) {
+            if (xfer->cmd == (UART_STATS | RS485_PROF)) rs485_tx_prof(RS485_MONITOR_ADDRESS, MASTER_ADDRESS, (uint8_t) xfer->state);
+            else rs485_tx_report((uint8_t) xfer->state, master_stats[xfer->state]);
+            xfer->status = XFER_DONE;   // nobody answers telemetry reports
+            master_xfer_head = (master_xfer_head + 1) % XFER_QUEUE_SIZE;
+            continue;
+        }
+        master_rsp_count = 0;
+        if (xfer->cmd == (UART_READ_CHANGES | RS485_SLOTTED)) {
+            rs485_tx_poll_slotted(master_cell_heard);   // answered by every cell in its slot
+        } else if (xfer->cmd == UART_READ_CHANGES) {
+            rs485_tx_read_changes(xfer->cell, xfer->seq);
+        } else if (xfer->cmd == UART_STEP) {
+            rs485_tx_step(RS485_STEP_HALO);     // answered by every cell in turn
+        } else {
+            rs485_tx(xfer->cell, xfer->cmd, xfer->state);
+        }
+        xfer->timer = stopwatch_start();
+        xfer->start_us = stopwatch_start_us();
+        xfer->status = XFER_BUSY;
+        return;
     }
-    UART_ClearRxBuffer();
-    CyDelay(10);    // delay needed for all to rsp to command. Likely a bus confliction issue, deal with later
 }
-   
-// Reads back single cell state
-uint32_t master_read_cell(uint8_t cell) {
-    rs485_tx(cell, UART_READ, 0);
-    uint32_t timer_confirmation = stopwatch_start();
-    uint32_t elapsed_time = 0;
-    rx_timeout = 0;
-    while (UART_GetRxBufferSize() != UART_RX_BUFFER_SIZE) {
-        CyDelay(1);
-        elapsed_time = stopwatch_elapsed_ms(timer_confirmation);
-        if (elapsed_time >= TOUT_SLV_RSP) {
-        //if (stopwatch_elapsed_ms(timer_confirmation) >= TOUT_SLV_RSP) {
-            // Timeout, clear buffer and send back 0s
+
+// Finishes the transaction on the bus, the next starts after the turnaround. Interrupts must be off.
+void master_xfer_finish(uint8_t status) {
+    master_xfer_t *xfer = &master_xfers[master_xfer_head];
+    uint32_t *stats = master_stats[xfer->cell < NUM_CELLS ? xfer->cell : NUM_CELLS];   // halo rounds and slotted polls count as the master's
+    stats[STAT_REQUESTS]++;
+    if (status == XFER_TIMEOUT) {
+        stats[STAT_TIMEOUTS]++;
+        if (master_rsp_count) stats[STAT_RSP_PARTIAL]++;
+        trace_put(TRACE_TIMEOUT, xfer->cell, xfer->cmd, master_rsp_count, 0, 0, 0);
+    } else {
+        uint32_t rtt_us = stopwatch_elapsed_us(xfer->start_us);
+        stats_rtt(stats, rtt_us);
+        // halos and slotted poll responses are traced as they come in
+        if (master_rsp_count && (master_rsp[0] & RS485_CMD_MASK) != UART_HALO && !(xfer->cmd == (UART_READ_CHANGES | RS485_SLOTTED))) {
+            rs485_trace(TRACE_RX, xfer->cell, master_rsp, master_rsp_count, rtt_us);
+        }
+    }
+    if (xfer->cmd == (UART_READ_CHANGES | RS485_SLOTTED)) {
+        // cells heard in their slot were counted as they came in, the rest timed out
+        for (uint8_t cell = 0; cell < NUM_CELLS; cell++) {
+            if ((master_slot_cells >> cell) & 1) continue;
+            master_stats[cell][STAT_REQUESTS]++;
+            master_stats[cell][STAT_TIMEOUTS]++;
+        }
+    }
+    xfer->status = status;
+    master_xfer_head = (master_xfer_head + 1) % XFER_QUEUE_SIZE;
+    master_turnaround = 1;
+    master_turnaround_us = stopwatch_start_us();
+}
+
+// Distributed Life halo round (CONWAY_DISTRIBUTED), cells the master heard from, bit n = cell n
+uint64_t master_halo_cells = 0;
+uint64_t master_halo_changed = 0;   // cells that set RS485_HALO_CHANGED
+uint64_t master_halo_settled = 0;   // cells that set RS485_SETTLED
+uint64_t master_halo_missed = 0;    // cells that set RS485_HALO_MISSED
+
+// Notes a UART_HALO (command byte first), returns 1 if it came from the last cell
+uint8_t master_halo_receive(uint8_t *packet) {
+    uint8_t cell = packet[1];
+    if (cell >= NUM_CELLS) return 0;
+    uint64_t bit = 1ull << cell;
+    master_halo_cells |= bit;
+    master_halo_edges[cell] = rs485_get_halo(&packet[2]);
+    if (packet[0] & RS485_HALO_CHANGED) master_halo_changed |= bit;
+    if (packet[0] & RS485_HALO_MISSED) master_halo_missed |= bit;
+    if (packet[0] & RS485_SETTLED) master_halo_settled |= bit;
+    return cell == NUM_CELLS - 1;
+}
+
+// Keeps a slotted poll response (command byte first), returns 1 if it came from the last cell
+uint8_t master_slot_receive(uint8_t *packet) {
+    uint8_t cell = packet[1];
+    if (cell >= NUM_CELLS) return 0;
+    uint8_t bytes = (packet[0] >> RS485_BYTES_SHIFT) & RS485_ALL_BYTES;
+    master_slot_cells |= 1ull << cell;
+    master_slot_left = NUM_CELLS - 1 - cell;
+    master_slot_flags[cell] = packet[0] & RS485_SETTLED;
+    master_slot_changed[cell] = rs485_bytes_mask(bytes);
+    master_slot_states[cell] = rs485_get_changes(&packet[2], bytes);
+    return cell == NUM_CELLS - 1;
+}
+
+// UART RX interrupt handler, completes the transaction on the bus once its response is in
+void master_rx_isr(void) {
+    if (master_xfer_head == master_xfer_tail || master_xfers[master_xfer_head].status != XFER_BUSY) {
+        UART_ClearRxBuffer();   // nothing expected, drop it
+        return;
+    }
+    master_xfer_t *xfer = &master_xfers[master_xfer_head];
+    // Responses differ in length, the first byte tells how long
+    while (master_rsp_count == 0 || master_rsp_count < rs485_rsp_len(master_rsp[0])) {
+        if (UART_GetRxBufferSize() == 0) return;
+        master_rsp[master_rsp_count++] = UART_ReadRxData();
+        if (master_rsp_count < rs485_rsp_len(master_rsp[0])) continue;
+        if ((master_rsp[0] & RS485_CMD_MASK) == UART_HALO) {
+            // a halo round has one response per cell, it's over with the last one
+            rs485_trace(TRACE_RX, master_rsp[1], master_rsp, master_rsp_count, 0);
+            if (master_halo_receive(master_rsp)) break;
+            master_rsp_count = 0;
+        } else if (xfer->cmd == (UART_READ_CHANGES | RS485_SLOTTED)) {
+            // so has a slotted poll, the round trip is as if the cell had been polled alone
+            uint32_t rtt_us = stopwatch_elapsed_us(xfer->start_us) - master_rsp[1] * RS485_SLOT_US;
+            rs485_trace(TRACE_RX, master_rsp[1], master_rsp, master_rsp_count, rtt_us);
+            if (master_rsp[1] < NUM_CELLS) {
+                master_stats[master_rsp[1]][STAT_REQUESTS]++;
+                stats_rtt(master_stats[master_rsp[1]], rtt_us);
+            }
+            if (master_slot_receive(master_rsp)) break;
+            master_rsp_count = 0;
+            xfer->timer = stopwatch_start();    // the rest of the slots follow this one
+        }
+    }
+    xfer->flags = master_rsp[0] & RS485_SETTLED;
+    if (xfer->cmd == (UART_READ_CHANGES | RS485_SLOTTED)) {
+        xfer->flags = 0;    // per cell, see master_slot_flags
+    } else if ((master_rsp[0] & RS485_CMD_MASK) == UART_READ_CHANGES) {
+        uint8_t bytes = (master_rsp[0] >> RS485_BYTES_SHIFT) & RS485_ALL_BYTES;
+        xfer->seq = master_rsp[1];
+        xfer->changed = rs485_bytes_mask(bytes);
+        xfer->state = rs485_get_changes(&master_rsp[2], bytes);
+    } else if (master_rsp[0] == (UART_STATS | RS485_PROF)) {
+        xfer->flags = 0;    // a span's counters, for the bus monitor
+    } else if ((master_rsp[0] & RS485_CMD_MASK) == UART_STATS) {
+        stats_get(master_stats[xfer->cell], &master_rsp[1], STATS_CELL_NUM);
+    } else if ((master_rsp[0] & RS485_CMD_MASK) == UART_HALO) {
+        xfer->flags = 0;    // per cell, see master_halo_settled
+    } else {
+        xfer->state = rs485_get_state(&master_rsp[1]);
+    }
+    master_xfer_finish(XFER_DONE);
+}
+
+// Starts the transaction engine
+void master_start(void) {
+    CySysTickStart();   // round trip timing
+    CySysTickSetReload(STOPWATCH_SYSTICK_MAX);
+    stopwatch_init();
+    rs485_rx_handler = master_rx_isr;
+}
+
+// Queues a transaction, returns 0 if the queue is full. For UART_READ_CHANGES state is the sequence.
+// `done` is called from master_poll once the transaction has finished.
+master_xfer_t *master_queue(uint8_t cell, uint8_t cmd, uint32_t state, void (*done)(master_xfer_t *xfer)) {
+    uint8 int_state = CyEnterCriticalSection();
+    uint8_t next = (master_xfer_tail + 1) % XFER_QUEUE_SIZE;
+    if (next == master_xfer_done) {
+        CyExitCriticalSection(int_state);
+        return 0;
+    }
+    master_xfer_t *xfer = &master_xfers[master_xfer_tail];
+    xfer->cell = cell;
+    xfer->cmd = cmd;
+    xfer->state = state;
+    xfer->flags = 0;
+    xfer->seq = (uint8_t) state;
+    xfer->changed = 0;
+    xfer->done = done;
+    xfer->status = XFER_QUEUED;
+    master_xfer_tail = next;
+    master_xfer_start();
+    CyExitCriticalSection(int_state);
+    return xfer;
+}
+
+// Handles response timeouts, starts the next request once the bus turned around and reports finished
+// transactions. Call from the main loop.
+void master_poll(void) {
+    uint8 int_state = CyEnterCriticalSection();
+    master_xfer_start();
+    if (master_xfer_head != master_xfer_tail) {
+        master_xfer_t *xfer = &master_xfers[master_xfer_head];
+        uint32_t timeout_ms = TOUT_SLV_RSP;
+        if ((xfer->cmd == (UART_READ_CHANGES | RS485_SLOTTED)) && master_slot_cells) {
+            // the request went out (it may have waited behind broadcasts), the slots are timed from the last cell heard
+            timeout_ms = master_slot_left * RS485_SLOT_US / 1000 + XFER_SLOT_SLACK_MS;
+        }
+        if (xfer->status == XFER_BUSY && stopwatch_elapsed_ms(xfer->timer) >= timeout_ms) {
             UART_ClearRxBuffer();
-            rx_timeout = 1;
-            return 0;
+            master_xfer_finish(XFER_TIMEOUT);
         }
     }
-    UART_ReadRxData();  // Ignore first R/W byte for now
-    uint32_t response = ((uint32_t) UART_ReadRxData() << 24) |
-                        ((uint32_t) UART_ReadRxData() << 16) |
-                        ((uint32_t) UART_ReadRxData() <<  8) |
-                        ((uint32_t) UART_ReadRxData() <<  0);
-    //UART_ClearRxBuffer();
-    CyDelay(10);    // delay needed for all to rsp to command. Likely a bus confliction issue, deal with later
-    return response;
+    CyExitCriticalSection(int_state);
+
+    while (master_xfer_done != master_xfer_head) {
+        master_xfer_t *xfer = &master_xfers[master_xfer_done];
+        if (xfer->done) xfer->done(xfer);
+        master_xfer_done = (master_xfer_done + 1) % XFER_QUEUE_SIZE;
+    }
+}
+
+// Runs one transaction to completion, returns its status
+uint8_t master_run(uint8_t cell, uint8_t cmd, uint32_t *state) {
+    master_xfer_t *xfer = master_queue(cell, cmd, *state, 0);
+    while (xfer == 0) {
+        master_poll();  // queue full, wait for room
+        xfer = master_queue(cell, cmd, *state, 0);
+    }
+    while (xfer->status == XFER_QUEUED || xfer->status == XFER_BUSY) {
+        master_poll();
+    }
+    *state = xfer->state;
+    return xfer->status;
+}
+
+// Writes to a singe cell, blocks until response received
+void master_write_cell(uint32_t cell, uint32_t state) {
+    master_run(cell, UART_WRITE, &state);
+}
+
+// Reads back single cell state, 0 on timeout
+uint32_t master_read_cell(uint8_t cell) {
+    uint32_t state = 0;
+    if (master_run(cell, UART_READ, &state) != XFER_DONE) return 0;
+    return state;
+}
+
+// Broadcasts one state per cell, only the segments holding a cell in `cells` (bit n = cell n) go out. Doesn't wait.
+void master_queue_write_all(uint32_t cell_states[NUM_CELLS], uint64_t cells) {
+    // The latest states go out with the broadcast, even if an older one is still queued
+    uint8 int_state = CyEnterCriticalSection();
+    memcpy(master_bcast_states, cell_states, sizeof(master_bcast_states));
+    master_bcast_cells |= cells;
+    CyExitCriticalSection(int_state);
+    while (master_queue(BROADCAST_ADDRESS, UART_WRITE_ALL, 0, 0) == 0) {
+        master_poll();
+    }
 }
 
 // Writes all cells to the same state
 void master_write_all(uint32_t state) {
+    uint32_t cell_states[NUM_CELLS];
     for (uint8_t i = 0; i < NUM_CELLS; i++) {
-        master_write_cell(i, state);
+        cell_states[i] = state;
     }
+    master_queue_write_all(cell_states, ALL_CELLS_MASK);
 }
 
-// Takes in a 16x16 grid, translates to 8 cell states (8bits each), and sets all states
-void master_write_grid(uint32_t grid[NUM_ROWS][NUM_COLS]) {
-    // Translate grid into cell states
-    uint32_t cell_states[NUM_CELLS] = {0};
-    for (uint32_t row = 0; row < NUM_ROWS; row++) {     // use # of MASTER rows
-        for (uint32_t col = 0; col < NUM_COLS; col++) { // use # of MASTER cols
-            if (grid[row][col]) {
-                uint32_t cell = (col / CELL_COLS) + 2 * (row/CELL_ROWS);
-                cell_states[cell] |= (1 << ((row % CELL_ROWS)* CELL_COLS + (col % CELL_COLS)));
-            }
+// Takes in the full grid, translates to one state per cell, and sets all states.
+// Broadcast segments without a cell in `cells` (bit n = cell n) are skipped, their cells keep their states.
+void master_write_grid(conway_frame_t grid, uint64_t cells) {
+    if (cells == 0) return; // nothing changed
+    // Translate grid into cell states (copies with CONWAY_ENGINE_TILES)
+    uint32_t cell_states[NUM_CELLS];
+    for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
+        cell_states[cell] = conway_get_tile(grid, cell);
+    }
+    // One broadcast, all cells switch together. Not acknowledged, the next read shows the new states.
+    master_queue_write_all(cell_states, cells);
+}
+
+// Grid read in progress. Cells only send what changed, master_cell_states holds the rest.
+uint32_t master_cell_states[NUM_CELLS];
+uint8_t  master_cell_seq[NUM_CELLS];    // sequence of the cell's last response
+uint8_t  master_cell_changed[NUM_CELLS];// 1 if the cell reported a change in the last grid read
+uint8_t  master_cell_valid[NUM_CELLS];  // 0 if the cell timed out
+uint8_t  master_cell_settled[NUM_CELLS];
+uint32_t master_reads_pending = 0;
+uint32_t master_read_start_us;      // stopwatch_start_us when the grid read started
+
+// Takes a cell's UART_READ_CHANGES response into the grid read, ok is 0 if it didn't answer
+void master_read_cell_changes(uint8_t cell, uint8_t ok, uint8_t flags, uint32_t changed, uint32_t state) {
+    master_cell_valid[cell] = ok;
+    master_cell_settled[cell] = (flags & RS485_SETTLED) != 0;
+    master_cell_changed[cell] = 0;
+    if (ok) {
+        master_cell_heard |= 1ull << cell;
+        master_cell_changed[cell] = changed != 0;
+        master_cell_states[cell] = (master_cell_states[cell] & ~changed) | state;
+    } else {
+        master_cell_heard &= ~(1ull << cell);
+    }
+}
+
+// Counts a finished read, the last one finishes the grid read
+void master_read_grid_count(void) {
+    if (--master_reads_pending == 0) {
+        master_stats[NUM_CELLS][STAT_REQUESTS]++;
+        stats_rtt(master_stats[NUM_CELLS], stopwatch_elapsed_us(master_read_start_us));
+    }
+}
+
+void master_read_grid_done(master_xfer_t *xfer) {
+    uint8_t cell = xfer->cell;
+    master_read_cell_changes(cell, xfer->status == XFER_DONE, xfer->flags, xfer->changed, xfer->state);
+    if (xfer->status == XFER_DONE) master_cell_seq[cell] = xfer->seq;
+    master_read_grid_count();
+}
+
+// Slotted poll finished, cells that missed their slot are polled on their own
+void master_read_slotted_done(master_xfer_t *xfer) {
+    for (uint8_t cell = 0; cell < NUM_CELLS; cell++) {
+        if ((master_slot_cells >> cell) & 1) {
+            master_read_cell_changes(cell, 1, master_slot_flags[cell], master_slot_changed[cell], master_slot_states[cell]);
+        } else if (master_queue(cell, UART_READ_CHANGES, RS485_SEQ_NONE, master_read_grid_done)) {
+            // its sequence is stale after slotted polls, it answers with all bytes
+            master_reads_pending++;
+        } else {
+            master_read_cell_changes(cell, 0, 0, 0, 0);     // no room, this read goes without it
         }
     }
+    master_read_grid_count();
+}
+
+// Queues a read of every cell, master_read_grid_ready() tells when they have all finished
+void master_read_grid_start(void) {
+    master_read_start_us = stopwatch_start_us();
+#if MASTER_POLL_SLOTTED
+    master_slot_cells = 0;
+    master_reads_pending++;
+    while (master_queue(BROADCAST_ADDRESS, UART_READ_CHANGES | RS485_SLOTTED, 0, master_read_slotted_done) == 0) {
+        master_poll();
+    }
+#else
     for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
-        master_write_cell(cell, cell_states[cell]);
+        while (master_queue(cell, UART_READ_CHANGES, master_cell_seq[cell], master_read_grid_done) == 0) {
+            master_poll();
+        }
+        master_reads_pending++;
     }
+#endif
+}
+
+// Returns 1 once the grid read started by master_read_grid_start() has finished
+uint8_t master_read_grid_ready(void) {
+    master_poll();
+    return master_reads_pending == 0;
 }
 
-// Updates grid based on cell states
-void master_read_grid(uint32_t grid[NUM_ROWS][NUM_COLS]) {
+// Updates grid based on the cell states of the last grid read
+void master_read_grid_finish(conway_frame_t grid) {
     for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
-        uint32_t cell_state = master_read_cell(cell);
-        if (rx_timeout) {
+        if (!master_cell_valid[cell]) {
             // skip updating this one if there was a timeout
-            rx_timeout = 0;
             continue;
         }
-        for (uint32_t row = 0; row < CELL_ROWS; row++) {
-            for (uint32_t col = 0; col < CELL_COLS; col++) {
-                uint32_t fan = cell_state & (1 << (row*CELL_COLS + col));
-                uint32_t master_row = CELL_ROWS * (cell / 2) + row;
-                uint32_t master_col = CELL_COLS * (cell % 2) + col;
-                grid[master_row][master_col] = fan;
+        if (!master_cell_changed[cell] && master_cell_states[cell] == master_bcast_states[cell]) {
+            // nothing new and it has the state last written, the grid already holds it
+            continue;
+        }
+        conway_set_tile(grid, cell, master_cell_states[cell]);
+    }
+}
+
+// Updates grid based on cell states, blocks until all cells answered or timed out
+void master_read_grid(conway_frame_t grid) {
+    master_read_grid_start();
+    while (!master_read_grid_ready());
+    master_read_grid_finish(grid);
+}
+
+// Traces the grid the master steps from, one state per cell
+void master_trace_grid(conway_frame_t grid) {
+    for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
+        trace_put(TRACE_GRID, cell, 0, 0, conway_get_tile(grid, cell), 0, 0);
+    }
+}
+
+// Traces a generation: its hash and population, and the stuck action taken if it repeated (period)
+void master_trace_step(conway_frame_t grid, uint32_t period, uint8_t action) {
+    conway_packed_t packed;
+    uint32_t hash = conway_pack(packed, grid);
+    uint32_t population = 0;
+    for (uint32_t tile = 0; tile < NUM_CELLS; tile++) population += __builtin_popcount(packed[tile]);
+    trace_put(TRACE_STEP, 0, (uint8_t) period, action, hash, 0, population);
+}
+
+// Returns 1 if every cell answered the last grid read and reported its fans settled
+uint8_t master_grid_settled(void) {
+    for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
+        if (!master_cell_valid[cell] || !master_cell_settled[cell]) return 0;
+    }
+    return 1;
+}
+
+// Counts an iteration of the master's main loop that started at the given stopwatch_start_us time
+void master_loop_done(uint32_t start_us) {
+    uint32_t us = stopwatch_elapsed_us(start_us);
+    if (us > master_stats[NUM_CELLS][STAT_LOOP_MAX_US]) master_stats[NUM_CELLS][STAT_LOOP_MAX_US] = us;
+}
+
+// Collects every cell's counters and sends a telemetry report per cell and one for the master, doesn't wait.
+// Reports go out behind the UART_STATS reads, with whatever the cells answered.
+// With the profiler (PROF_ENABLE) every cell's spans are read too, the bus monitor takes them off the bus
+// (a read of PROF_NUM spans takes ~PROF_NUM * 6ms per cell), and the master's own go out behind them.
+void master_stats_report(void) {
+    for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
+        while (master_queue(cell, UART_STATS, 0, 0) == 0) {
+            master_poll();
+        }
+    }
+    for (uint32_t cell = 0; cell <= NUM_CELLS; cell++) {
+        while (master_queue(RS485_MONITOR_ADDRESS, UART_STATS, cell, 0) == 0) {
+            master_poll();
+        }
+    }
+    if (!PROF_ENABLE) return;
+    for (uint32_t cell = 0; cell <= NUM_CELLS; cell++) {
+        uint8_t addr = cell < NUM_CELLS ? cell : RS485_MONITOR_ADDRESS;
+        for (uint32_t span = 0; span < PROF_NUM; span++) {
+            while (master_queue(addr, UART_STATS | RS485_PROF, span, 0) == 0) {
+                master_poll();
             }
         }
     }
 }
+
+// Distributed Life (CONWAY_DISTRIBUTED): the cells step their own tiles, the master only paces them (halo.h)
+uint8_t master_halo_pending = 0;
+uint8_t master_halo_stepped = 0;    // set once master_halo_step_edges holds a step's round
+
+void master_halo_done(master_xfer_t *xfer) {
+    master_halo_pending = 0;
+}
+
+// Broadcasts the start of a halo round, master_halo_ready() tells when every cell sent its halo or the round timed out
+void master_halo_start(void) {
+    uint8 int_state = CyEnterCriticalSection();
+    master_halo_cells = master_halo_changed = master_halo_settled = master_halo_missed = 0;
+    CyExitCriticalSection(int_state);
+    master_halo_pending = 1;
+    while (master_queue(BROADCAST_ADDRESS, UART_STEP, RS485_STEP_HALO, master_halo_done) == 0) {
+        master_poll();
+    }
+}
+
+// Returns 1 once the halo round started by master_halo_start() has finished
+uint8_t master_halo_ready(void) {
+    master_poll();
+    return master_halo_pending == 0;
+}
+
+// Returns 1 if every cell sent its halo in the last round and reported its fans settled
+uint8_t master_halo_all_settled(void) {
+    return master_halo_cells == ALL_CELLS_MASK && master_halo_settled == ALL_CELLS_MASK;
+}
+
+// Resends the halos of the last step's round to every cell that missed it in the round that just finished.
+// Returns 1 if there were any, the round has to be run again before the next step. Doesn't wait.
+uint8_t master_halo_resync(void) {
+    if (!master_halo_missed || !master_halo_stepped) return 0;  // nothing to resend since a reset, they drop it
+    for (uint32_t cell = 0; cell < NUM_CELLS; cell++) {
+        conway_tiles_t bit = (conway_tiles_t) 1 << cell;
+        if (!(master_halo_missed & bit)) continue;
+        conway_tiles_t around = conway_tiles_around(bit) & ~bit;
+        for (uint32_t from = 0; from < NUM_CELLS; from++) {
+            if (!((around >> from) & 1)) continue;
+            while (master_queue((uint8_t) cell, UART_HALO | RS485_HALO_RESYNC, from, 0) == 0) {
+                master_poll();
+            }
+        }
+    }
+    return 1;
+}
+
+// Broadcasts a step, every cell steps its tile with the halos of the last round. Doesn't wait.
+// Only call it after a round master_halo_cells is ALL_CELLS_MASK for.
+void master_step(void) {
+    memcpy(master_halo_step_edges, master_halo_edges, sizeof(master_halo_edges));
+    master_halo_stepped = 1;
+    while (master_queue(BROADCAST_ADDRESS, UART_STEP, RS485_STEP_GO, 0) == 0) {
+        master_poll();
+    }
+}
@@ -0,0 +1,68 @@
+// Generated by host/rle2c from patterns/, do not edit. Regenerate with make -C host patterns
+#pragma once
+// Included by conway.h. Each row is a word, bit n = column n.
+
+// Acorn, methuselah
+const uint32_t conway_acorn_rows[] = {0x02, 0x08, 0x73};
+const conway_pattern_t conway_acorn = {3, 7, conway_acorn_rows};
+
+// Beacon, period 2
+const uint32_t conway_beacon_rows[] = {0x3, 0x1, 0x8, 0xc};
+const conway_pattern_t conway_beacon = {4, 4, conway_beacon_rows};
+
+// All off
+const uint32_t conway_dead_rows[] = {0};
+const conway_pattern_t conway_dead = {0, 0, conway_dead_rows};
+
+// Diehard, dies out after 130 generations on an open plane
+const uint32_t conway_diehard_rows[] = {0x40, 0x03, 0xe2};
+const conway_pattern_t conway_diehard = {3, 8, conway_diehard_rows};
+
+// Glider, moves one cell diagonally every 4 generations
+const uint32_t conway_glider_rows[] = {0x2, 0x4, 0x7};
+const conway_pattern_t conway_glider = {3, 3, conway_glider_rows};
+
+// Lightweight spaceship, moves across the wall
+const uint32_t conway_lwss_rows[] = {0x12, 0x01, 0x11, 0x0f};
+const conway_pattern_t conway_lwss = {4, 5, conway_lwss_rows};
+
+// Oscillators with a period of 2
+const uint32_t conway_osc_rows[] = {0x007, 0x700, 0x380, 0x000, 0x000, 0x003, 0x003, 0x00c, 0x00c};
+const conway_pattern_t conway_osc = {9, 11, conway_osc_rows};
+
+// Pentadecathlon, period 15
+const uint32_t conway_pentadecathlon_rows[] = {0x084, 0x37b, 0x084};
+const conway_pattern_t conway_pentadecathlon = {3, 10, conway_pentadecathlon_rows};
+
+// Pulsar, period 3
+const uint32_t conway_pulsar_rows[] = {0x071c, 0x0000, 0x10a1, 0x10a1, 0x10a1, 0x071c, 0x0000, 0x071c, 0x10a1, 0x10a1, 0x10a1, 0x0000, 0x071c};
+const conway_pattern_t conway_pulsar = {13, 13, conway_pulsar_rows};
+
+// R-pentomino, keeps changing for a long time
+const uint32_t conway_r_pentomino_rows[] = {0x6, 0x3, 0x2};
+const conway_pattern_t conway_r_pentomino = {3, 3, conway_r_pentomino_rows};
+
+// Still lifes, no movement
+const uint32_t conway_still_lifes_rows[] = {0x183, 0x243, 0x180, 0x000, 0x000, 0x60c, 0xa12, 0x414, 0x008, 0x000, 0x000, 0x100, 0x280, 0x100};
+const conway_pattern_t conway_still_lifes = {14, 12, conway_still_lifes_rows};
+
+// Toad, period 2
+const uint32_t conway_toad_rows[] = {0xe, 0x7};
+const conway_pattern_t conway_toad = {2, 4, conway_toad_rows};
+
+// Every pattern above, in file order
+const conway_pattern_t *const conway_patterns[] = {
+    &conway_acorn,
+    &conway_beacon,
+    &conway_dead,
+    &conway_diehard,
+    &conway_glider,
+    &conway_lwss,
+    &conway_osc,
+    &conway_pentadecathlon,
+    &conway_pulsar,
+    &conway_r_pentomino,
+    &conway_still_lifes,
+    &conway_toad,
+};
+#define CONWAY_NUM_PATTERNS 12
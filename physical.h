@@ -1,14 +1,45 @@
-// For master (full grid)
-#define NUM_ROWS        16
-#define NUM_COLS        16
-#define NUM_CELLS       8   // number of slave cells
+#pragma once
+/*
+Wall topology, the single place the wall size is set. Override at build time
+(e.g. -DGRID_CELL_ROWS=8 -DGRID_CELL_COLS=4 for a 32x32 wall).
+The grid is GRID_CELL_ROWS x GRID_CELL_COLS cells, numbered row by row:
+0, 1, ... GRID_CELL_COLS-1
+GRID_CELL_COLS, ...
+*/
+#ifndef GRID_CELL_ROWS
+#define GRID_CELL_ROWS  4   // cells down the wall
+#endif
+#ifndef GRID_CELL_COLS
+#define GRID_CELL_COLS  2   // cells across the wall
+#endif
 
 // For cells
+#ifndef CELL_ROWS
 #define CELL_ROWS       4   // number of rows in a cell
+#endif
+#ifndef CELL_COLS
 #define CELL_COLS       8   // number of columns in a cell
+#endif
 #define FANS_PER_CELL   (CELL_ROWS * CELL_COLS)  // number of fans in each cell
+#define EDGE_FANS_PER_CELL  (2 * CELL_COLS + 2 * (CELL_ROWS - 2))  // fans on the edges of a cell
+
+// For master (full grid)
+#define NUM_CELLS       (GRID_CELL_ROWS * GRID_CELL_COLS)   // number of slave cells
+#define NUM_ROWS        (GRID_CELL_ROWS * CELL_ROWS)
+#define NUM_COLS        (GRID_CELL_COLS * CELL_COLS)
+#define ALL_CELLS_MASK  (~0ull >> (64 - NUM_CELLS))   // bit n = cell n
+
+#if (FANS_PER_CELL > 32)
+#error  cell fan states must fit in a uint32_t
+#elif (CELL_ROWS < 2)
+#error  cells need at least 2 rows
+#elif (NUM_CELLS > 64)
+#error  the bus supports up to 64 cells
+#elif (NUM_COLS > 64)
+#error  the grid supports up to 64 columns
+#endif
 
-/* 
+/*
 Each cell contains 4 rows of 8 fans (32 total fans).
 Fans are physically indexed like so:
 0,  ... , 7
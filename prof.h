@@ -0,0 +1,127 @@
+#pragma once
+#include "project.h"
+#include "stopwatch.h"
+
+/*
+Span profiler. PROF_BEGIN(span) and PROF_END(span) around a hot path count
+the cycles in between into the span's row of prof_log: how often it ran, the
+shortest, longest and total, and a histogram. Cycles come from the Cortex-M3's
+DWT cycle counter, the host build counts the node's own run time instead (ns,
+see host/hal.c). A span is begun and ended by the same context (main loop or
+interrupt) and not begun again before it ends, interrupts that come in
+meanwhile are counted in.
+Off unless PROF_ENABLE is set, the markers compile to nothing then. With it the
+master collects every cell's spans with its telemetry and sends them and its
+own to the bus monitor (UART_STATS | RS485_PROF, see rs485.h and host/sim -S),
+host/sim -P prints every node's prof_log at the end of a run.
+*/
+#ifndef PROF_ENABLE
+#define PROF_ENABLE     0
+#endif
+
+// Cycle counter, the DWT's (CMSIS core_cm3.h). host/project.h brings its own.
+#ifndef PROF_CYCLES
+#define PROF_CYCLES()       (DWT->CYCCNT)
+#define PROF_CYCLES_START() do { CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; } while (0)
+#define PROF_CYCLES_PER_US  STOPWATCH_CYCLES_PER_US
+#endif
+
+// Spans
+#define PROF_LOOP           0   // main loop iteration, one task run on cells (scheduler.h)
+#define PROF_TICK_LATENCY   1   // SysTick interrupt, tick to the tach sampling (SysTick counts)
+#define PROF_TACH_ISR       2   // tach_isr
+#define PROF_PWM_ISR        3   // pwm_isr
+#define PROF_GPIOX_SEND     4   // gpiox_send, interrupts off
+#define PROF_RS485_TX       5   // rs485_send
+#define PROF_RX_ISR         6   // UART RX interrupt
+#define PROF_STEP           7   // a generation: conway_update_frame on the master, halo_step on cells
+#define PROF_NUM            8
+
+// Counters of a span
+#define PROF_COUNT          0   // spans ended
+#define PROF_MIN            1   // cycles
+#define PROF_MAX            2
+#define PROF_TOTAL_LO       3   // sum of all spans, 64 bits
+#define PROF_TOTAL_HI       4
+#define PROF_HIST           5   // bucket n counts < PROF_HIST_MIN << (PROF_HIST_SHIFT * n), the last one the rest
+#define PROF_BUCKETS        8
+#define PROF_HIST_MIN       64
+#define PROF_HIST_SHIFT     2
+#define PROF_COUNTERS       (PROF_HIST + PROF_BUCKETS)
+#define PROF_MAGIC          0x464C5250  // "PRLF"
+
+typedef struct {
+    uint32_t magic;         // PROF_MAGIC
+    uint32_t bytes;         // size of prof_log
+    uint32_t node;          // bus address
+    uint32_t spans;         // PROF_NUM
+    uint32_t counters;      // PROF_COUNTERS
+    uint32_t cycles_per_us; // PROF_CYCLES_PER_US
+    uint32_t hist_min;      // PROF_HIST_MIN
+    uint32_t hist_shift;    // PROF_HIST_SHIFT
+    uint32_t span[PROF_NUM][PROF_COUNTERS];
+} prof_log_t;
+
+#if PROF_ENABLE
+#define PROF_BEGIN(span)            (prof_start[span] = PROF_CYCLES())
+#define PROF_END(span)              prof_count(span, PROF_CYCLES() - prof_start[span])
+#define PROF_SAMPLE(span, cycles)   prof_count(span, cycles)
+
+prof_log_t prof_log;
+uint32_t prof_start[PROF_NUM];  // cycle count at PROF_BEGIN
+
+// Starts the cycle counter
+void prof_init(uint8_t node) {
+    PROF_CYCLES_START();
+    prof_log.magic = PROF_MAGIC;
+    prof_log.bytes = sizeof(prof_log);
+    prof_log.node = node;
+    prof_log.spans = PROF_NUM;
+    prof_log.counters = PROF_COUNTERS;
+    prof_log.cycles_per_us = PROF_CYCLES_PER_US;
+    prof_log.hist_min = PROF_HIST_MIN;
+    prof_log.hist_shift = PROF_HIST_SHIFT;
+}
+
+// Returns the histogram bucket of a span
+uint32_t prof_bucket(uint32_t cycles) {
+    uint32_t bucket = 0;
+    while (bucket < PROF_BUCKETS - 1 && cycles >= ((uint32_t) PROF_HIST_MIN << (PROF_HIST_SHIFT * bucket))) bucket++;
+    return bucket;
+}
+
+// Counts a span of the given length
+void prof_count(uint8_t span, uint32_t cycles) {
+    uint32_t *c = prof_log.span[span];
+    if (c[PROF_COUNT] == 0 || cycles < c[PROF_MIN]) c[PROF_MIN] = cycles;
+    if (cycles > c[PROF_MAX]) c[PROF_MAX] = cycles;
+    c[PROF_COUNT]++;
+    c[PROF_TOTAL_LO] += cycles;
+    if (c[PROF_TOTAL_LO] < cycles) c[PROF_TOTAL_HI]++;
+    c[PROF_HIST + prof_bucket(cycles)]++;
+}
+
+// Copies a span's counters, all 0 for an unknown span
+void prof_get(uint8_t span, uint32_t counters[PROF_COUNTERS]) {
+    if (span >= PROF_NUM) {
+        memset(counters, 0, PROF_COUNTERS * sizeof(uint32_t));
+        return;
+    }
+    uint8 int_state = CyEnterCriticalSection();
+    memcpy(counters, prof_log.span[span], PROF_COUNTERS * sizeof(uint32_t));
+    CyExitCriticalSection(int_state);
+}
+#else
+#define PROF_BEGIN(span)            ((void) 0)
+#define PROF_END(span)              ((void) 0)
+#define PROF_SAMPLE(span, cycles)   ((void) 0)
+
+void prof_init(uint8_t node) {
+    (void) node;
+}
+
+void prof_get(uint8_t span, uint32_t counters[PROF_COUNTERS]) {
+    (void) span;
+    memset(counters, 0, PROF_COUNTERS * sizeof(uint32_t));
+}
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+#include "gpiox.h"
+#include "physical.h"
+#include "prof.h"
+#include "project.h"
+#include "tach.h"
+
+/*
+Soft PWM. The SysTick interrupt (next to the tach sampling, every
+PWM_TICK_MS) works out which fans are powered and queues the expander writes
+when that changes, so slowing fans down never blocks the main loop.
+A PWM period is PWM_LEVELS ticks, a fan at level n is powered for the first n
+ticks of it, PWM_LEVELS is full speed. Levels are double buffered: they are
+changed in the back buffer and the interrupt swaps it in at the start of the
+next period, so a period never mixes old and new levels.
+A pulse powers every fan, on or off, at the start of every
+PWM_PULSE_PERIOD_MS (meant to quiet the whine of fans trying to spin).
+*/
+#define PWM_TICK_MS         TACH_SAMPLE_MS  // runs on the tach's SysTick
+#define PWM_SYSTICK_CB      2               // SysTick callback slot
+#define PWM_LEVELS          16              // ticks per PWM period, speed levels of a fan
+#define PWM_PULSE_PERIOD_MS 256             // a pulse goes out this often
+#ifndef PWM_DEFAULT_LEVEL
+#define PWM_DEFAULT_LEVEL   PWM_LEVELS      // speed at startup, until UART_CONFIG changes it
+#endif
+
+uint8_t  pwm_levels[FANS_PER_CELL];         // speed of each fan, 0 to PWM_LEVELS
+uint32_t pwm_masks[2][PWM_LEVELS];          // fans powered at each tick of the period, front and back buffer
+volatile uint8_t  pwm_front = 0;            // buffer the interrupt uses
+volatile uint8_t  pwm_swap = 0;             // set once the back buffer is ready to be swapped in
+volatile uint32_t pwm_state = 0;            // fans that are on
+volatile uint32_t pwm_pulse_ticks = 0;      // pulse length, 0 for none
+uint32_t pwm_tick = 0;                      // tick within the PWM period
+uint32_t pwm_pulse_tick = 0;                // tick within the pulse period
+uint32_t pwm_out = 0;                       // fans powered right now
+
+// Writes the powered fans to the expanders, queued (see gpiox.h). Interrupts must be off.
+void pwm_write(uint32_t out) {
+    pwm_out = out;
+    gpiox_send(GPIOXA, ADDR_PORTA, ((uint8_t)(out >> 00)), ((uint8_t)(out >> 8)));
+    gpiox_send(GPIOXB, ADDR_PORTA, ((uint8_t)(out >> 16)), ((uint8_t)(out >> 24)));
+}
+
+// Fans powered at this tick
+uint32_t pwm_frame(void) {
+    if (pwm_pulse_tick < pwm_pulse_ticks) return UINT32_MAX;
+    return pwm_state & pwm_masks[pwm_front][pwm_tick];
+}
+
+// SysTick callback, runs the PWM period
+void pwm_isr(void) {
+    if (!stopwatch_ticked) return;  // a one-shot, not a tick
+    PROF_BEGIN(PROF_PWM_ISR);
+    pwm_tick = (pwm_tick + 1) % PWM_LEVELS;
+    pwm_pulse_tick = (pwm_pulse_tick + 1) % (PWM_PULSE_PERIOD_MS / PWM_TICK_MS);
+    if (pwm_tick == 0 && pwm_swap) {
+        pwm_front ^= 1;
+        pwm_swap = 0;
+    }
+    uint32_t out = pwm_frame();
+    if (out != pwm_out) pwm_write(out);
+    PROF_END(PROF_PWM_ISR);
+}
+
+// Builds the back buffer from pwm_levels and hands it to the interrupt
+void pwm_commit(void) {
+    pwm_swap = 0;   // the interrupt leaves the back buffer alone while it isn't ready
+    uint32_t *masks = pwm_masks[pwm_front ^ 1];
+    for (uint32_t tick = 0; tick < PWM_LEVELS; tick++) {
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < FANS_PER_CELL; i++) {
+            if (pwm_levels[i] > tick) mask |= 1u << i;
+        }
+        masks[tick] = mask;
+    }
+    pwm_swap = 1;
+}
+
+// Sets the speed of a fan (0 to PWM_LEVELS), takes effect with pwm_commit
+void pwm_set_level(uint32_t fan, uint8_t level) {
+    pwm_levels[fan] = level < PWM_LEVELS ? level : PWM_LEVELS;
+}
+
+// Sets the speed of every fan
+void pwm_set_all(uint8_t level) {
+    for (uint32_t i = 0; i < FANS_PER_CELL; i++) pwm_set_level(i, level);
+    pwm_commit();
+}
+
+// Converts an 8 bit duty cycle (UART_CONFIG) to a level, 0 is full speed, anything else keeps the fan turning
+uint8_t pwm_duty_level(uint8_t duty) {
+    if (duty == 0) return PWM_LEVELS;
+    return (uint8_t) ((duty * PWM_LEVELS + 254) / 255);
+}
+
+// Sets the pulse length, 0 turns pulsing off
+void pwm_set_pulse(uint32_t ms) {
+    pwm_pulse_ticks = ms < PWM_PULSE_PERIOD_MS ? ms / PWM_TICK_MS : PWM_PULSE_PERIOD_MS / PWM_TICK_MS - 1;
+}
+
+// Turns fans on/off, powered right away if their level has them on at this tick
+void pwm_set_state(uint32_t state) {
+    uint8 int_state = CyEnterCriticalSection();
+    pwm_state = state;
+    pwm_write(pwm_frame());
+    CyExitCriticalSection(int_state);
+}
+
+// Starts the PWM at PWM_DEFAULT_LEVEL, after tach_init (which starts the SysTick)
+void pwm_init(void) {
+    for (uint32_t i = 0; i < FANS_PER_CELL; i++) pwm_set_level(i, PWM_DEFAULT_LEVEL);
+    pwm_commit();       // back buffer
+    pwm_front ^= 1;
+    pwm_commit();       // and the front one before the interrupt uses it
+    CySysTickSetCallback(PWM_SYSTICK_CB, pwm_isr);
+}
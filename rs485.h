@@ -1,14 +1,62 @@
 #pragma once
+#include "physical.h"
+#include "prof.h"
 #include "project.h"
+#include "stats.h"
+#include "trace.h"
 
 #define UART_READ       0   // fan read command
 #define UART_WRITE      1   // fan write command
 #define UART_CONFIG     2   // cell configure command
+#define UART_WRITE_ALL  3   // broadcast fan write command, one state per cell
+#define UART_READ_CHANGES 4 // fan read command, only the state bytes changed since the master's last read
+#define UART_STATS      5   // bus telemetry counters, see stats.h
+#define UART_STEP       6   // distributed Life: broadcast, starts a halo round or steps every cell (halo.h)
+#define UART_HALO       7   // distributed Life: a cell's edge fans, broadcast by the cell
 
-#define MASTER_ADDRESS  8
-#define PACKET_SIZE     6
+#define RS485_CMD_MASK      0x07    // command bits of the command byte
+#define RS485_BYTES_SHIFT   3       // changed state bytes of a UART_READ_CHANGES response, bit n = fans 8n to 8n+7
+#define RS485_ALL_BYTES     0x0F
+#define RS485_SETTLED   0x80    // set on the command byte of a cell's response once its fans reached their states
+#define RS485_SEQ_NONE      0       // UART_READ_CHANGES sequence of a master that knows nothing yet, never handed out by cells
+#define RS485_STEP_HALO     0       // UART_STEP: every cell broadcasts its halo
+#define RS485_STEP_GO       1       // UART_STEP: every cell steps with the halos of the last round
+#define RS485_HALO_CHANGED  0x08    // set on UART_HALO if the cell's state changed since its last halo
+#define RS485_HALO_MISSED   0x10    // set on UART_HALO while the cell is a step behind, it missed a halo (halo.h)
+#define RS485_HALO_RESYNC   0x20    // set on a UART_HALO the master resends to a cell that missed it
+#define RS485_SLOTTED       0x80    // set on a UART_READ_CHANGES to BROADCAST_ADDRESS, every cell answers in its slot
+#define RS485_PROF          0x80    // set on a UART_STATS for a profiler span (prof.h) instead of the counters
 
-/* 
+#define MASTER_ADDRESS      NUM_CELLS   // cells are 0 to NUM_CELLS-1
+#define BROADCAST_ADDRESS   255 // cells' UART Address2, every cell receives it
+#define RS485_MONITOR_ADDRESS 254   // nobody listens, the master's telemetry reports for a bus monitor
+#define PACKET_SIZE         6
+
+#define RS485_SEG_CELLS     (NUM_CELLS < 8 ? NUM_CELLS : 8) // cell states per UART_WRITE_ALL packet
+#define RS485_NUM_SEGS      ((NUM_CELLS + RS485_SEG_CELLS - 1) / RS485_SEG_CELLS)
+
+#define RS485_RSP_SIZE      (PACKET_SIZE - 1)           // bytes received for a response
+#define RS485_STATS_SIZE    (1 + 4 * STATS_CELL_NUM)    // bytes received for a UART_STATS response
+#define RS485_HALO_BYTES    ((EDGE_FANS_PER_CELL + 7) / 8)
+#define RS485_HALO_SIZE     (2 + RS485_HALO_BYTES)      // bytes received for a UART_HALO
+#define RS485_PROF_SIZE     (3 + 4 * PROF_COUNTERS)     // bytes received for a UART_STATS | RS485_PROF response
+#define RS485_RSP_MAX       RS485_PROF_SIZE             // largest response
+#define RS485_RX_MAX        (2 + 4 * RS485_SEG_CELLS)   // largest packet a cell receives (UART_WRITE_ALL)
+#define RS485_RX_BUFFER_MIN (RS485_RX_MAX + RS485_RSP_SIZE) // a broadcast plus a queued command
+
+// Slotted polls (RS485_SLOTTED), times from the end of the request
+#define RS485_BAUD          115200  // UART component's baud rate
+#define RS485_BYTE_US       ((11 * 1000000 + RS485_BAUD - 1) / RS485_BAUD)  // start, 8 data, mark/space and stop bits
+#define RS485_HEARD_BYTES   ((NUM_CELLS + 7) / 8)   // cells bitmap of a slotted poll
+#define RS485_SLOT_BYTES    7       // longest answer: address, command, cell and 4 state bytes
+#ifndef RS485_SLOT_GUARD_US
+#define RS485_SLOT_GUARD_US 100     // between slots, covers the cells' late starts and bus turnaround
+#endif
+#ifndef RS485_SLOT_US
+#define RS485_SLOT_US       (RS485_SLOT_BYTES * RS485_BYTE_US + RS485_SLOT_GUARD_US)
+#endif
+
+/*
     All communication will be 6 byes sent in this order:
     1. Receiver's address
     2. read or write
@@ -16,21 +64,393 @@
     4. fans 16-23
     5. fans 8-15
     6. fans 0-7
-    
-    Receiver processes data once it detects a full buffer of *5 bytes.
+
+    Receiver processes data once it has received the full packet for the command (*5 bytes).
+    Cells respond with the same command, RS485_SETTLED is set if no fan is still spinning up or down.
     *NOTE: UART hardware detect-to-buffer only passed data bytes to buffer, not address.
-*/  
+
+    The exception is UART_WRITE_ALL, sent to BROADCAST_ADDRESS in RS485_NUM_SEGS
+    packets (segments) of RS485_SEG_CELLS cells each, back to back:
+    1. BROADCAST_ADDRESS
+    2. UART_WRITE_ALL
+    3. segment number
+    4. state of cell segment * RS485_SEG_CELLS (4 bytes, fans 24-31 first)
+    ...
+    N. state of cell (segment + 1) * RS485_SEG_CELLS - 1 (0 past the last cell)
+    Each cell takes its state from its own segment and doesn't respond.
+
+    UART_READ_CHANGES is short both ways. The master sends the sequence of the
+    last response it got from the cell (RS485_SEQ_NONE at first):
+    1. Receiver's address
+    2. UART_READ_CHANGES
+    3. sequence
+    The cell counts its changes and answers with only the state bytes that
+    changed since that sequence (all of them if it doesn't match its own):
+    1. MASTER_ADDRESS
+    2. UART_READ_CHANGES | changed bytes << RS485_BYTES_SHIFT (| RS485_SETTLED)
+    3. cell's sequence
+    4. changed state bytes, fans 24-31 first (none if nothing changed)
+
+    A slotted poll reads every cell with one request. The master broadcasts
+    which cells' last UART_READ_CHANGES response it got (bit n = cell n):
+    1. BROADCAST_ADDRESS
+    2. UART_READ_CHANGES | RS485_SLOTTED
+    3. cells 0-7 heard, then 8-15... (RS485_HEARD_BYTES bytes)
+    Cell n answers RS485_SLOT_GUARD_US + n * RS485_SLOT_US after the request,
+    like a UART_READ_CHANGES response with its cell number in place of the
+    sequence: the bytes changed since its last response if the master heard
+    it, else all of them. A cell that can't make its slot stays quiet and the
+    master polls it on its own.
+
+    UART_STATS is sent like a read, cells answer with their counters (stats.h):
+    1. MASTER_ADDRESS
+    2. UART_STATS
+    3. STATS_CELL_NUM counters, 4 bytes each, big endian
+    With RS485_PROF set the request's state is a profiler span (prof.h), cells
+    answer with its counters:
+    1. MASTER_ADDRESS
+    2. UART_STATS | RS485_PROF
+    3. cell
+    4. span
+    5. PROF_COUNTERS counters, 4 bytes each, big endian
+    The master sends its own spans the same way to RS485_MONITOR_ADDRESS.
+
+    Distributed Life (CONWAY_DISTRIBUTED) is broadcast both ways, the master
+    listens on BROADCAST_ADDRESS too:
+    1. BROADCAST_ADDRESS
+    2. UART_STEP
+    3. RS485_STEP_HALO or RS485_STEP_GO
+    After RS485_STEP_HALO every cell sends its edge fans in cell order:
+    1. BROADCAST_ADDRESS
+    2. UART_HALO (| RS485_HALO_CHANGED | RS485_HALO_MISSED | RS485_SETTLED)
+    3. cell
+    4. edge fans packed by conway_edge_pack, RS485_HALO_BYTES bytes, last ones first
+    To a cell that set RS485_HALO_MISSED the master resends the halos of the
+    cells around it from the round the missed step used, nobody answers:
+    1. cell
+    2. UART_HALO | RS485_HALO_RESYNC
+    3. cell the halo came from
+    4. its edge fans
+*/
+// Returns 1 for a packet (command byte first) of idle polling: reads and halos that carry no change
+uint8_t rs485_idle(const uint8_t *packet, uint8_t len) {
+    uint8_t cmd = packet[0] & RS485_CMD_MASK;
+    if (cmd == UART_READ_CHANGES) {
+        // request, or a response without state bytes
+        return len <= 2 || (packet[0] == (UART_READ_CHANGES | RS485_SLOTTED) && len == 1 + RS485_HEARD_BYTES);
+    }
+    if (cmd == UART_HALO) return !(packet[0] & (RS485_HALO_CHANGED | RS485_HALO_MISSED | RS485_HALO_RESYNC));
+    if (cmd == UART_STEP) return len == 2 && packet[1] == RS485_STEP_HALO;
+    return 0;
+}
+
+// Traces a packet (command byte first), idle polling only with TRACE_POLLS
+void rs485_trace(uint8_t type, uint8_t addr, const uint8_t *packet, uint8_t len, uint32_t aux) {
+    if (!TRACE_POLLS && rs485_idle(packet, len) && aux < TRACE_SLOW_US) return;
+    trace_packet(type, addr, packet, len, aux);
+}
+
+// Puts a packet (address byte first) on the bus
+void rs485_send(const uint8_t *tx_data, uint8_t len) {
+    PROF_BEGIN(PROF_RS485_TX);
+    rs485_trace(TRACE_TX, tx_data[0], &tx_data[1], len - 1, 0);
+    UART_SetTxAddressMode(UART_SET_MARK);
+    UART_PutArray(tx_data, len);
+    UART_SetTxAddressMode(UART_SET_SPACE);
+    PROF_END(PROF_RS485_TX);
+}
+
 void rs485_tx(uint8_t addr, uint8_t read_write, uint32_t state) {
     UART_ClearRxBuffer();   // make sure there is space for the response
     uint8_t tx_data[PACKET_SIZE] = {
-        addr, 
+        addr,
         read_write,
         ((uint8_t) (state >> 24)),
         ((uint8_t) (state >> 16)),
         ((uint8_t) (state >>  8)),
         ((uint8_t) (state >>  0))
     };
-    UART_SetTxAddressMode(UART_SET_MARK);
-    UART_PutArray(tx_data, PACKET_SIZE);
-    UART_SetTxAddressMode(UART_SET_SPACE);
+    rs485_send(tx_data, PACKET_SIZE);
+}
+
+// Requests the state bytes a cell changed since sequence seq
+void rs485_tx_read_changes(uint8_t addr, uint8_t seq) {
+    UART_ClearRxBuffer();   // make sure there is space for the response
+    uint8_t tx_data[3] = {addr, UART_READ_CHANGES, seq};
+    rs485_send(tx_data, sizeof(tx_data));
+}
+
+// Broadcasts a slotted poll, heard has bit n set if the master got cell n's last response
+void rs485_tx_poll_slotted(uint64_t heard) {
+    UART_ClearRxBuffer();   // make sure there is space for the responses
+    uint8_t tx_data[2 + RS485_HEARD_BYTES];
+    tx_data[0] = BROADCAST_ADDRESS;
+    tx_data[1] = UART_READ_CHANGES | RS485_SLOTTED;
+    for (uint32_t i = 0; i < RS485_HEARD_BYTES; i++) tx_data[2 + i] = (uint8_t) (heard >> (8 * i));
+    rs485_send(tx_data, sizeof(tx_data));
+}
+
+// Returns 1 if a slotted poll (command byte first) says the master heard the cell's last response
+uint8_t rs485_get_heard(uint8_t *packet, uint8_t cell) {
+    return (packet[1 + cell / 8] >> (cell % 8)) & 1;
+}
+
+// Returns the bytes (bit n = fans 8n to 8n+7) holding any bit of changed
+uint8_t rs485_changed_bytes(uint32_t changed) {
+    uint8_t bytes = 0;
+    for (uint32_t n = 0; n < 4; n++) {
+        if ((changed >> (8 * n)) & 0xFF) bytes |= (1 << n);
+    }
+    return bytes;
+}
+
+// Puts the answer to a UART_READ_CHANGES with the given bytes of state into tx_data (1 + RS485_RSP_MAX bytes),
+// returns its length. cmd may carry RS485_SETTLED. A slotted poll is answered with the cell in place of seq.
+uint8_t rs485_put_changes(uint8_t *tx_data, uint8_t cmd, uint8_t seq, uint32_t state, uint8_t bytes) {
+    uint8_t len = 0;
+    tx_data[len++] = MASTER_ADDRESS;
+    tx_data[len++] = cmd | (bytes << RS485_BYTES_SHIFT);
+    tx_data[len++] = seq;
+    for (int n = 3; n >= 0; n--) {
+        if ((bytes >> n) & 1) tx_data[len++] = (uint8_t) (state >> (8 * n));
+    }
+    return len;
+}
+
+// Answers a UART_READ_CHANGES with the given bytes of state, see rs485_put_changes
+void rs485_tx_changes(uint8_t cmd, uint8_t seq, uint32_t state, uint8_t bytes) {
+    uint8_t tx_data[1 + RS485_RSP_MAX];
+    rs485_send(tx_data, rs485_put_changes(tx_data, cmd, seq, state, bytes));
+}
+
+// Returns the state bytes of a UART_READ_CHANGES response starting at data[0], other bytes 0
+uint32_t rs485_get_changes(uint8_t *data, uint8_t bytes) {
+    uint32_t state = 0;
+    for (int n = 3; n >= 0; n--) {
+        if ((bytes >> n) & 1) state |= (uint32_t) *data++ << (8 * n);
+    }
+    return state;
+}
+
+// Returns the fans (bits) carried by the given state bytes
+uint32_t rs485_bytes_mask(uint8_t bytes) {
+    uint32_t mask = 0;
+    for (uint32_t n = 0; n < 4; n++) {
+        if ((bytes >> n) & 1) mask |= (uint32_t) 0xFF << (8 * n);
+    }
+    return mask;
+}
+
+// Number of bytes the master receives for a response, given its first (command) byte
+uint32_t rs485_rsp_len(uint8_t cmd) {
+    if ((cmd & RS485_CMD_MASK) == UART_READ_CHANGES) {
+        return 2 + __builtin_popcount((cmd >> RS485_BYTES_SHIFT) & RS485_ALL_BYTES);
+    }
+    if (cmd == (UART_STATS | RS485_PROF)) return RS485_PROF_SIZE;
+    if ((cmd & RS485_CMD_MASK) == UART_STATS) return RS485_STATS_SIZE;
+    if ((cmd & RS485_CMD_MASK) == UART_HALO) return RS485_HALO_SIZE;
+    return RS485_RSP_SIZE;
+}
+
+// Answers a UART_STATS with the cell's counters
+void rs485_tx_stats(const uint32_t counters[STATS_CELL_NUM]) {
+    uint8_t tx_data[1 + RS485_STATS_SIZE];
+    tx_data[0] = MASTER_ADDRESS;
+    tx_data[1] = UART_STATS;
+    stats_put(&tx_data[2], counters, STATS_CELL_NUM);
+    rs485_send(tx_data, sizeof(tx_data));
+}
+
+// Sends the master's telemetry report of a cell to RS485_MONITOR_ADDRESS
+void rs485_tx_report(uint8_t cell, const uint32_t counters[STATS_NUM]) {
+    uint8_t tx_data[3 + 4 * STATS_NUM];
+    tx_data[0] = RS485_MONITOR_ADDRESS;
+    tx_data[1] = UART_STATS;
+    tx_data[2] = cell;
+    stats_put(&tx_data[3], counters, STATS_NUM);
+    rs485_send(tx_data, sizeof(tx_data));
+}
+
+// Sends a node's profiler span (prof.h), cells answer the master, the master reports its own to RS485_MONITOR_ADDRESS
+void rs485_tx_prof(uint8_t addr, uint8_t node, uint8_t span) {
+    uint8_t tx_data[1 + RS485_PROF_SIZE];
+    uint32_t counters[PROF_COUNTERS];
+    prof_get(span, counters);
+    tx_data[0] = addr;
+    tx_data[1] = UART_STATS | RS485_PROF;
+    tx_data[2] = node;
+    tx_data[3] = span;
+    stats_put(&tx_data[4], counters, PROF_COUNTERS);
+    rs485_send(tx_data, sizeof(tx_data));
+}
+
+// Broadcasts a distributed Life step, phase is RS485_STEP_HALO or RS485_STEP_GO
+void rs485_tx_step(uint8_t phase) {
+    uint8_t tx_data[3] = {BROADCAST_ADDRESS, UART_STEP, phase};
+    rs485_send(tx_data, sizeof(tx_data));
+}
+
+// Sends a cell's packed edge fans, broadcast by the cell itself. cmd may carry RS485_HALO_CHANGED,
+// RS485_HALO_MISSED and RS485_SETTLED, or RS485_HALO_RESYNC from the master.
+void rs485_tx_halo(uint8_t address, uint8_t cmd, uint8_t cell, uint32_t edges) {
+    uint8_t tx_data[1 + RS485_HALO_SIZE];
+    tx_data[0] = address;
+    tx_data[1] = cmd;
+    tx_data[2] = cell;
+    for (uint32_t i = 0; i < RS485_HALO_BYTES; i++) {
+        tx_data[3 + i] = (uint8_t) (edges >> (8 * (RS485_HALO_BYTES - 1 - i)));
+    }
+    rs485_send(tx_data, sizeof(tx_data));
+}
+
+// Returns the packed edge fans of a UART_HALO starting at data[0]
+uint32_t rs485_get_halo(uint8_t *data) {
+    uint32_t edges = 0;
+    for (uint32_t i = 0; i < RS485_HALO_BYTES; i++) edges = (edges << 8) | data[i];
+    return edges;
+}
+
+// Returns the next sequence after seq, skips RS485_SEQ_NONE
+uint8_t rs485_next_seq(uint8_t seq) {
+    seq++;
+    return seq == RS485_SEQ_NONE ? seq + 1 : seq;
+}
+
+// Returns the big endian state starting at data[0]
+uint32_t rs485_get_state(uint8_t *data) {
+    return ((uint32_t) data[0] << 24) |
+           ((uint32_t) data[1] << 16) |
+           ((uint32_t) data[2] <<  8) |
+           ((uint32_t) data[3] <<  0);
+}
+
+// Broadcasts one state per cell, RS485_SEG_CELLS cells per packet.
+// Only segments holding a cell in `cells` (bit n = cell n) are sent.
+void rs485_tx_all(uint8_t cmd, uint32_t states[NUM_CELLS], uint64_t cells) {
+    for (uint32_t seg = 0; seg < RS485_NUM_SEGS; seg++) {
+        if (((cells >> (seg * RS485_SEG_CELLS)) & (~0ull >> (64 - RS485_SEG_CELLS))) == 0) continue;
+        uint8_t tx_data[1 + RS485_RX_MAX];
+        tx_data[0] = BROADCAST_ADDRESS;
+        tx_data[1] = cmd;
+        tx_data[2] = (uint8_t) seg;
+        for (uint32_t i = 0; i < RS485_SEG_CELLS; i++) {
+            uint32_t cell = seg * RS485_SEG_CELLS + i;
+            uint32_t state = cell < NUM_CELLS ? states[cell] : 0;
+            tx_data[3 + 4 * i + 0] = (uint8_t) (state >> 24);
+            tx_data[3 + 4 * i + 1] = (uint8_t) (state >> 16);
+            tx_data[3 + 4 * i + 2] = (uint8_t) (state >>  8);
+            tx_data[3 + 4 * i + 3] = (uint8_t) (state >>  0);
+        }
+        rs485_send(tx_data, sizeof(tx_data));
+    }
+}
+
+// Returns this cell's state from a UART_WRITE_ALL packet (command byte first), 0 if it's in another segment
+uint8_t rs485_get_all_state(uint8_t *packet, uint8_t cell, uint32_t *state) {
+    if (packet[1] != cell / RS485_SEG_CELLS) return 0;
+    *state = rs485_get_state(&packet[2 + 4 * (cell % RS485_SEG_CELLS)]);
+    return 1;
+}
+
+// Number of bytes a cell receives for a command, including the command byte
+uint32_t rs485_rx_len(uint8_t cmd) {
+    if (cmd == UART_WRITE_ALL) return RS485_RX_MAX;
+    if (cmd == UART_READ_CHANGES || cmd == UART_STEP) return 2;
+    if (cmd == (UART_READ_CHANGES | RS485_SLOTTED)) return 1 + RS485_HEARD_BYTES;
+    if ((cmd & RS485_CMD_MASK) == UART_HALO) return RS485_HALO_SIZE;
+    return PACKET_SIZE - 1;
+}
+
+// Bytes a cell received. The RX interrupt moves them out of the UART into a ring and tells the packets apart as they
+// come in, so it knows when each one ended; the main loop takes them out of the ring a packet at a time.
+#define RS485_RX_RING       64      // a power of two up to 256
+#if RS485_RX_RING < RS485_RX_BUFFER_MIN
+#error "RS485_RX_RING is too small for a broadcast plus a queued command"
+#endif
+#if UART_RX_BUFFER_SIZE <= 4
+#error "UART RX buffer must be over 4 bytes, the UART only has its RX interrupt (UART_RXISR_ExitCallback) then"
+#endif
+uint8_t  rs485_rx_ring[RS485_RX_RING];
+volatile uint8_t  rs485_rx_in = 0;      // bytes put into the ring (wraps)
+volatile uint8_t  rs485_rx_out = 0;     // bytes taken out (wraps)
+uint8_t  rs485_rx_isr_cmd = 0;          // command of the packet the interrupt is in
+uint32_t rs485_rx_isr_count = 0;        // its bytes so far
+volatile uint32_t rs485_rx_ended = 0;   // packets the interrupt saw end
+volatile uint32_t rs485_rx_end_us = 0;  // stopwatch_start_us when the last of them ended
+uint32_t rs485_rx_taken = 0;            // packets the main loop took
+
+// Packet being received by a cell, rs485_rx_packet[0] is the command
+uint8_t  rs485_rx_packet[RS485_RX_MAX];
+uint32_t rs485_rx_count = 0;
+uint8_t  rs485_rx_timed = 0;            // rs485_rx_at_us is known: no packet ended after this one
+uint32_t rs485_rx_at_us = 0;            // stopwatch_start_us when its last byte came in
+
+// Cell UART RX interrupt handler, moves the bytes into the ring
+void rs485_rx_isr(void) {
+    while (UART_GetRxBufferSize() != 0) {
+        uint8_t byte = UART_ReadRxData();
+        if ((uint8_t) (rs485_rx_in - rs485_rx_out) == RS485_RX_RING) continue;    // full, the RX timeout cleans up
+        rs485_rx_ring[rs485_rx_in++ % RS485_RX_RING] = byte;
+        if (rs485_rx_isr_count == 0) rs485_rx_isr_cmd = byte;
+        if (++rs485_rx_isr_count == rs485_rx_len(rs485_rx_isr_cmd)) {
+            rs485_rx_isr_count = 0;
+            rs485_rx_ended++;
+            rs485_rx_end_us = stopwatch_start_us();
+        }
+    }
+}
+
+// Returns 1 if received bytes are waiting in the ring
+uint8_t rs485_rx_waiting(void) {
+    return rs485_rx_in != rs485_rx_out;
+}
+
+// Moves received bytes into rs485_rx_packet, stops at the end of a packet.
+// Returns 1 when a full packet is waiting to be handled.
+uint8_t rs485_rx_poll(void) {
+    while (rs485_rx_count == 0 || rs485_rx_count < rs485_rx_len(rs485_rx_packet[0])) {
+        if (!rs485_rx_waiting()) return 0;
+        rs485_rx_packet[rs485_rx_count++] = rs485_rx_ring[rs485_rx_out++ % RS485_RX_RING];
+        if (rs485_rx_count == rs485_rx_len(rs485_rx_packet[0])) {
+            // the interrupt saw it end with the same byte
+            uint8 int_state = CyEnterCriticalSection();
+            rs485_rx_taken++;
+            rs485_rx_timed = rs485_rx_ended == rs485_rx_taken;
+            rs485_rx_at_us = rs485_rx_end_us;
+            CyExitCriticalSection(int_state);
+        }
+    }
+    return 1;
+}
+
+// Drops the packet being received
+void rs485_rx_clear(void) {
+    rs485_rx_count = 0;
+}
+
+// Drops everything received so far, the packet being received included
+void rs485_rx_flush(void) {
+    uint8 int_state = CyEnterCriticalSection();
+    UART_ClearRxBuffer();
+    rs485_rx_out = rs485_rx_in;
+    rs485_rx_isr_count = 0;
+    rs485_rx_taken = rs485_rx_ended;
+    rs485_rx_count = 0;
+    CyExitCriticalSection(int_state);
+}
+
+// Sets up the receive side the schematic may not have: Address2 = BROADCAST_ADDRESS if `broadcast` (cells, and
+// the master for distributed Life)
+void rs485_rx_init(uint8_t broadcast) {
+    if (broadcast) UART_SetRxAddress2(BROADCAST_ADDRESS);
+}
+
+// Called from the UART RX interrupt for every received byte, set by whoever owns the bus
+void (*rs485_rx_handler)(void) = 0;
+
+// UART RX ISR exit callback (enabled in cyapicallbacks.h)
+void UART_RXISR_ExitCallback(void) {
+    PROF_BEGIN(PROF_RX_ISR);
+    if (rs485_rx_handler) rs485_rx_handler();
+    PROF_END(PROF_RX_ISR);
 }
@@ -0,0 +1,144 @@
+#pragma once
+#include "physical.h"
+#include "project.h"
+#include "rs485.h"
+#include "tach.h"
+
+/*
+Cooperative scheduler for the cell's main loop. The loop's work is split into
+tasks that run to completion, highest priority (lowest number) first:
+interrupts and timers post them, sched_next() hands out the next ready one
+and sleeps while there is none. A received packet is handled as soon as the
+task running when it came in returns, instead of after a pass over every fan.
+Deadlines (fan spin ups, the RX timeout, halo turns and snapshots) sit on a
+timer wheel the SysTick turns one slot per tick, a timer costs nothing until
+its slot comes up; a slotted poll answer goes out from a SysTick one-shot
+instead (slot.h). The tach sampling wakes the fan task when a fan
+starts or stops, or when a fan in sched_watch pulses (coasting fans are
+checked on their own pulses).
+*/
+#define SCHED_SYSTICK_CB    3       // SysTick callback slot, after the tach sampling
+#define SCHED_WHEEL_SLOTS   64      // ticks per turn of the wheel, later deadlines go around again
+#define SCHED_TIMER_NONE    0xFF
+
+// Tasks, by priority
+#define SCHED_TASK_RX       0   // bytes received
+#define SCHED_TASK_HALO     1   // distributed Life halo (halo.h)
+#define SCHED_TASK_FANS     2   // fan states, validations and human input
+#define SCHED_TASK_RX_TOUT  3   // partial packet timed out
+#define SCHED_TASK_WARM     4   // warm start snapshot (warm.h)
+#define SCHED_TASKS         5
+
+// Timers, one per fan for its spin up and one per task that waits for a time
+#define SCHED_TIMER_RX      (FANS_PER_CELL + 0)
+#define SCHED_TIMER_HALO    (FANS_PER_CELL + 1)
+#define SCHED_TIMER_WARM    (FANS_PER_CELL + 2)
+#define SCHED_TIMERS        (FANS_PER_CELL + 3)
+
+typedef struct {
+    uint32_t due;       // tach_now_ms it fires at
+    uint8_t  task;      // posted when it fires
+    uint8_t  armed;
+    uint8_t  prev;      // timers in the same wheel slot
+    uint8_t  next;
+} sched_timer_t;
+
+volatile uint32_t sched_ready = 0;          // tasks posted, bit n = task n
+uint32_t sched_watch = 0;                   // fans whose pulses post SCHED_TASK_FANS
+uint32_t sched_tach_state = 0;              // tach_state as of the last tick
+sched_timer_t sched_timers[SCHED_TIMERS];
+uint8_t  sched_wheel[SCHED_WHEEL_SLOTS];    // first timer of each slot
+
+// Takes a timer off the wheel. Interrupts must be off.
+void sched_unlink(uint8_t id) {
+    sched_timer_t *t = &sched_timers[id];
+    if (!t->armed) return;
+    if (t->prev != SCHED_TIMER_NONE) sched_timers[t->prev].next = t->next;
+    else sched_wheel[(t->due / TACH_SAMPLE_MS) % SCHED_WHEEL_SLOTS] = t->next;
+    if (t->next != SCHED_TIMER_NONE) sched_timers[t->next].prev = t->prev;
+    t->armed = 0;
+}
+
+// SysTick callback, fires the timers of this tick and wakes the fan task
+void sched_tick(void) {
+    if (!stopwatch_ticked) return;  // a one-shot, not a tick
+    uint32_t now = tach_now_ms;
+    uint8_t id = sched_wheel[(now / TACH_SAMPLE_MS) % SCHED_WHEEL_SLOTS];
+    while (id != SCHED_TIMER_NONE) {
+        sched_timer_t *t = &sched_timers[id];
+        uint8_t next = t->next;
+        if ((int32_t) (now - t->due) >= 0) {
+            sched_unlink(id);
+            sched_ready |= 1u << t->task;
+        }
+        id = next;
+    }
+    if (tach_state != sched_tach_state || (tach_rising & sched_watch)) {
+        sched_tach_state = tach_state;
+        sched_ready |= 1u << SCHED_TASK_FANS;
+    }
+}
+
+// UART RX interrupt handler
+void sched_rx_isr(void) {
+    rs485_rx_isr();
+    sched_ready |= 1u << SCHED_TASK_RX;
+}
+
+// Starts the scheduler, after tach_init (which starts the SysTick). Every task runs once to begin with.
+void sched_init(void) {
+    memset(sched_wheel, SCHED_TIMER_NONE, sizeof(sched_wheel));
+    sched_ready = (1u << SCHED_TASKS) - 1;
+    rs485_rx_handler = sched_rx_isr;
+    CySysTickSetCallback(SCHED_SYSTICK_CB, sched_tick);
+}
+
+// Posts a task from the main loop
+void sched_post(uint8_t task) {
+    uint8 int_state = CyEnterCriticalSection();
+    sched_ready |= 1u << task;
+    CyExitCriticalSection(int_state);
+}
+
+// Posts `task` in `ms` (at least the next tick), restarts the timer if it's running
+void sched_timer_start(uint8_t id, uint8_t task, uint32_t ms) {
+    uint8 int_state = CyEnterCriticalSection();
+    sched_unlink(id);
+    sched_timer_t *t = &sched_timers[id];
+    t->due = tach_now_ms + (ms > TACH_SAMPLE_MS ? ms : TACH_SAMPLE_MS);
+    t->task = task;
+    t->armed = 1;
+    uint8_t *slot = &sched_wheel[(t->due / TACH_SAMPLE_MS) % SCHED_WHEEL_SLOTS];
+    t->prev = SCHED_TIMER_NONE;
+    t->next = *slot;
+    if (*slot != SCHED_TIMER_NONE) sched_timers[*slot].prev = id;
+    *slot = id;
+    CyExitCriticalSection(int_state);
+}
+
+void sched_timer_stop(uint8_t id) {
+    uint8 int_state = CyEnterCriticalSection();
+    sched_unlink(id);
+    CyExitCriticalSection(int_state);
+}
+
+uint8_t sched_timer_armed(uint8_t id) {
+    return sched_timers[id].armed;
+}
+
+// Returns the ready task with the highest priority, sleeps until there is one. Interrupts are masked
+// around the check so one coming in right after it still ends the WFI (it wakes on a pending interrupt).
+uint8_t sched_next(void) {
+    for (;;) {
+        uint8 int_state = CyEnterCriticalSection();
+        uint32_t ready = sched_ready;
+        if (ready) {
+            uint8_t task = (uint8_t) __builtin_ctz(ready);
+            sched_ready = ready & ~(1u << task);
+            CyExitCriticalSection(int_state);
+            return task;
+        }
+        __WFI();
+        CyExitCriticalSection(int_state);
+    }
+}
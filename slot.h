@@ -0,0 +1,43 @@
+#pragma once
+#include "project.h"
+#include "rs485.h"
+#include "stopwatch.h"
+
+/*
+Slotted polls, cell side (RS485_SLOTTED). A UART_READ_CHANGES to
+BROADCAST_ADDRESS is answered by every cell in its own time slot, cell n at
+RS485_SLOT_GUARD_US + n * RS485_SLOT_US after the request, so the master
+reads the wall with one request. The slot counts from the request's last byte
+as the RX interrupt saw it (rs485_rx_at_us), not from when a task got to it.
+The answer is made up as the request is handled and goes out from the SysTick
+interrupt at the start of the slot (stopwatch_shot), the tasks run meanwhile.
+A cell that got to the request more than a guard band into its slot stays
+quiet rather than talk over the next slot, the master then polls it on its own.
+*/
+uint8_t  slot_cell;         // this cell
+uint32_t slot_at_us = 0;    // start of this cell's slot (stopwatch_start_us)
+uint8_t  slot_packet[1 + RS485_RSP_MAX];    // answer, address byte first
+uint8_t  slot_len = 0;
+
+void slot_init(uint8_t cell) {
+    slot_cell = cell;
+}
+
+// Puts the answer on the bus, from the SysTick interrupt
+void slot_send(void) {
+    rs485_send(slot_packet, slot_len);
+}
+
+// Slotted poll received that ended at end_us, `timed` if that's known (rs485_rx_timed, else another packet came
+// in after it and the slot has gone by). Returns 1 if there is still time to answer.
+uint8_t slot_start(uint8_t timed, uint32_t end_us) {
+    slot_at_us = end_us + RS485_SLOT_GUARD_US + (uint32_t) slot_cell * RS485_SLOT_US;
+    return timed && (int32_t) (stopwatch_start_us() - slot_at_us) <= RS485_SLOT_GUARD_US;
+}
+
+// Sends the answer (address byte first) at the start of the slot
+void slot_answer(const uint8_t *packet, uint8_t len) {
+    memcpy(slot_packet, packet, len);
+    slot_len = len;
+    stopwatch_shot(slot_at_us, slot_send);
+}
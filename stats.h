@@ -0,0 +1,73 @@
+#pragma once
+#include "physical.h"
+#include "project.h"
+
+/*
+Bus telemetry. Cells count what they receive and answer UART_STATS with their
+counters (STAT_PACKETS to STAT_LOOP_MAX_US). The master adds its own counters
+per cell (STAT_REQUESTS and up) and every STATS_PERIOD_MS collects the cells'
+counters and sends one report per cell to RS485_MONITOR_ADDRESS, where no node
+listens, for a bus monitor to decode (see host/telemetry.c):
+    1. RS485_MONITOR_ADDRESS
+    2. UART_STATS
+    3. cell, MASTER_ADDRESS for the master's own report
+    4. STATS_NUM counters, 4 bytes each, big endian
+In the master's own report STAT_LOOP_MAX_US is its main loop and the round
+trip counters are for whole grid reads.
+Counters only go up (STAT_*_MAX_US hold the max), the monitor diffs reports.
+The STAT_*_MAX_US times come from stopwatch_elapsed_us (stopwatch.h): exact to
+1us up to ~71 min, but a span that keeps interrupts off for more than one
+SysTick period (1ms on cells) reads a period short per period missed.
+*/
+#define STATS_PERIOD_MS     10000   // how often the master collects and reports
+
+// Counted by the cell
+#define STAT_PACKETS        0   // packets handled
+#define STAT_RX_TIMEOUTS    1   // TOUT_RX_COMM buffer clears
+#define STAT_RX_PARTIAL     2   // of those, with part of a packet received (else stray bytes)
+#define STAT_RESYNCS        3   // UART_READ_CHANGES answered in full because the master missed a response, or
+                                // a distributed Life step caught up on the halos the master resent (halo.h)
+#define STAT_LOOP_MAX_US    4   // longest task run (scheduler.h), the time a received packet can wait
+#define STATS_CELL_NUM      5
+// Counted by the master
+#define STAT_REQUESTS       5   // requests that expect a response
+#define STAT_TIMEOUTS       6   // no full response within TOUT_SLV_RSP
+#define STAT_RSP_PARTIAL    7   // of those, with part of a response received
+#define STAT_RTT_MAX_US     8   // longest round trip, request sent to response received
+#define STAT_RTT_HIST       9   // round trip histogram, bucket n counts < STATS_RTT_MIN_US << n, the last one the rest
+#define STATS_RTT_BUCKETS   8
+#define STATS_RTT_MIN_US    128
+#define STATS_NUM           (STAT_RTT_HIST + STATS_RTT_BUCKETS)
+
+// Returns the histogram bucket of a round trip
+uint32_t stats_rtt_bucket(uint32_t us) {
+    uint32_t bucket = 0;
+    while (bucket < STATS_RTT_BUCKETS - 1 && us >= (STATS_RTT_MIN_US << bucket)) bucket++;
+    return bucket;
+}
+
+// Counts a round trip into counters
+void stats_rtt(uint32_t counters[STATS_NUM], uint32_t us) {
+    counters[STAT_RTT_HIST + stats_rtt_bucket(us)]++;
+    if (us > counters[STAT_RTT_MAX_US]) counters[STAT_RTT_MAX_US] = us;
+}
+
+// Writes n counters big endian into data
+void stats_put(uint8_t *data, const uint32_t *counters, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        data[4 * i + 0] = (uint8_t) (counters[i] >> 24);
+        data[4 * i + 1] = (uint8_t) (counters[i] >> 16);
+        data[4 * i + 2] = (uint8_t) (counters[i] >>  8);
+        data[4 * i + 3] = (uint8_t) (counters[i] >>  0);
+    }
+}
+
+// Reads n big endian counters from data
+void stats_get(uint32_t *counters, const uint8_t *data, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        counters[i] = ((uint32_t) data[4 * i + 0] << 24) |
+                      ((uint32_t) data[4 * i + 1] << 16) |
+                      ((uint32_t) data[4 * i + 2] <<  8) |
+                      ((uint32_t) data[4 * i + 3] <<  0);
+    }
+}
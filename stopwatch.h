@@ -3,6 +3,7 @@
 
 // timeouts, units of ms
 #define TOUT_FAN_SET    6000    // Fan state validation timeout (fans take ~6s to spin down)
+#define TOUT_FAN_SPINUP 2000    // Fan spin up validation timeout (fans take ~1s to spin up)
 #define TOUT_RX_COMM    300     // UART RX timeout from first byte (packet should take 0.5ms to finish)
 #define TOUT_SLV_RSP    500     // Slave responce timeout.
 
@@ -18,3 +19,145 @@ uint32_t stopwatch_elapsed_ms(uint32_t time_ms) {
     // Handle counter rollover
     return (time_ms + (Timer_ReadPeriod() - curr_time_ms));
 }
+
+/*
+Microsecond timing from the SysTick counter plus a count of its periods, kept
+by a SysTick callback (1ms periods on cells, where it samples the tachs,
+~0.7s on the master). A period is a whole number of us, else its remainder
+would add up period after period. Good to 1us for intervals up to ~71 min
+(2^32 us), as long as the SysTick interrupt isn't held off for a whole period:
+a period that ended while interrupts were off is counted from the SysTick count
+flag, a second one would go missing.
+
+One-shot. There is no spare timer, so stopwatch_shot() has the SysTick
+interrupt come in at the given time by splitting the period it falls in: the
+count starts again with the time up to the shot, and reloads with the rest of
+the period when it gets there, so the periods still end where they would have.
+The shot's interrupt runs the SysTick callbacks too, the ones that go by the
+period check stopwatch_ticked first. A shot in the last STOPWATCH_SHOT_REST_US
+of a period goes at the end of it instead (the rest has to outlast the shot's
+interrupt latency, else the period after it would be as short).
+*/
+#define STOPWATCH_CYCLES_PER_US (CYDEV_BCLK__SYSCLK__HZ / 1000000)
+#define STOPWATCH_SYSTICK_MAX   (0x1000000u / STOPWATCH_CYCLES_PER_US * STOPWATCH_CYCLES_PER_US - 1)  // longest reload of whole us
+#define STOPWATCH_SYSTICK_CB    0           // SysTick callback slot, ahead of the others
+#define STOPWATCH_SHOT_MIN_US   2           // a shot closer than this goes at once
+#define STOPWATCH_SHOT_REST_US  50          // shortest rest of a split period
+
+// What the count reaching 0 was, bits
+#define STOPWATCH_END_PERIOD    1
+#define STOPWATCH_END_SHOT      2
+
+uint32_t stopwatch_reload;                  // SysTick reload of a period
+uint32_t stopwatch_period_us;               // its us
+volatile uint32_t stopwatch_periods = 0;    // SysTick periods since stopwatch_init
+volatile uint8_t  stopwatch_ahead = 0;      // STOPWATCH_END_* counted before their interrupt ran
+volatile uint8_t  stopwatch_ticked = 0;     // the SysTick interrupt being run ends a period (not only the shot)
+uint32_t stopwatch_part_at = 0;             // cycles of the period before the count last started (split periods)
+uint32_t stopwatch_part_top = 0;            // value it started from
+uint32_t stopwatch_rest_top = 0;            // value it starts from after the shot
+volatile uint8_t stopwatch_split = 0;       // the count runs to the shot
+volatile uint8_t stopwatch_shot_armed = 0;  // a shot is waiting
+uint32_t stopwatch_shot_us;                 // its stopwatch_start_us time
+void (*stopwatch_shot_fn)(void);            // called from the SysTick interrupt when it's time
+
+// Counts the SysTick count reaching 0, returns STOPWATCH_END_*
+uint8_t stopwatch_end(void) {
+    if (stopwatch_split) {
+        stopwatch_split = 0;
+        stopwatch_part_at += stopwatch_part_top + 1;
+        stopwatch_part_top = stopwatch_rest_top;
+        return STOPWATCH_END_SHOT;
+    }
+    stopwatch_periods++;
+    stopwatch_part_at = 0;
+    stopwatch_part_top = stopwatch_reload;
+    return STOPWATCH_END_PERIOD;
+}
+
+// Returns the cycles into the current period. Interrupts must be off, counts an end whose interrupt hasn't run yet.
+uint32_t stopwatch_cycles(void) {
+    uint32_t count = CySysTickGetValue();
+    if (CySysTickGetCountFlag()) {
+        stopwatch_ahead |= stopwatch_end();
+        count = CySysTickGetValue();
+    }
+    return stopwatch_part_at + stopwatch_part_top - count;
+}
+
+// Splits the current period for the shot if it's due in it, or runs it if it's due. Interrupts must be off.
+void stopwatch_shot_split(void) {
+    if (!stopwatch_shot_armed || stopwatch_split) return;
+    uint32_t cycles = stopwatch_cycles();
+    if (stopwatch_ahead) return;    // the SysTick interrupt is pending, it comes back here
+    int32_t wait_us = (int32_t) (stopwatch_shot_us - (stopwatch_periods * stopwatch_period_us + cycles / STOPWATCH_CYCLES_PER_US));
+    if (wait_us < STOPWATCH_SHOT_MIN_US) {
+        stopwatch_shot_armed = 0;
+        stopwatch_shot_fn();
+        return;
+    }
+    uint32_t count = stopwatch_part_at + stopwatch_part_top - cycles;   // as read by stopwatch_cycles
+    uint32_t shot = (uint32_t) wait_us * STOPWATCH_CYCLES_PER_US;
+    if (shot + STOPWATCH_SHOT_REST_US * STOPWATCH_CYCLES_PER_US > count) return;   // at the end of the period or later
+    CySysTickSetReload(shot - 1);
+    CySysTickClear();
+    stopwatch_part_at += stopwatch_part_top - count;
+    stopwatch_part_top = shot - 1;
+    stopwatch_rest_top = count - shot - 1;
+    CySysTickSetReload(stopwatch_rest_top);    // the count has taken the shot's, this one is for after it
+    stopwatch_split = 1;
+}
+
+// SysTick callback, counts the periods and runs the shot
+void stopwatch_tick(void) {
+    uint8_t end = stopwatch_ahead;
+    stopwatch_ahead = 0;
+    if (!end) end = stopwatch_end();
+    CySysTickGetCountFlag();    // reading clears it, the next end sets it again
+    stopwatch_ticked = (end & STOPWATCH_END_PERIOD) != 0;
+    if (end & STOPWATCH_END_SHOT) {
+        CySysTickSetReload(stopwatch_reload);   // for the period after the rest of this one
+        stopwatch_shot_armed = 0;
+        stopwatch_shot_fn();
+    }
+    stopwatch_shot_split();
+}
+
+// Starts counting SysTick periods from here, call once SysTick runs with its reload
+void stopwatch_init(void) {
+    stopwatch_reload = CySysTickGetReload();
+    stopwatch_period_us = (stopwatch_reload + 1) / STOPWATCH_CYCLES_PER_US;
+    stopwatch_periods = 0;
+    stopwatch_ahead = 0;
+    stopwatch_part_at = 0;
+    stopwatch_part_top = stopwatch_reload;
+    CySysTickClear();
+    CySysTickSetCallback(STOPWATCH_SYSTICK_CB, stopwatch_tick);
+}
+
+// Returns the current time in us (wraps after ~71 min)
+uint32_t stopwatch_start_us(void) {
+    uint8 int_state = CyEnterCriticalSection();
+    uint32_t cycles = stopwatch_cycles();
+    uint32_t us = stopwatch_periods * stopwatch_period_us + cycles / STOPWATCH_CYCLES_PER_US;
+    CyExitCriticalSection(int_state);
+    return us;
+}
+
+// Returns the us since the given stopwatch_start_us time
+uint32_t stopwatch_elapsed_us(uint32_t start_us) {
+    return stopwatch_start_us() - start_us;
+}
+
+// Calls fn from the SysTick interrupt at the stopwatch_start_us time at_us, right away if that's (about) now.
+// One shot at a time: a new one replaces one that is waiting for its period, and is dropped while one is split.
+void stopwatch_shot(uint32_t at_us, void (*fn)(void)) {
+    uint8 int_state = CyEnterCriticalSection();
+    if (!stopwatch_split) {
+        stopwatch_shot_us = at_us;
+        stopwatch_shot_fn = fn;
+        stopwatch_shot_armed = 1;
+        stopwatch_shot_split();
+    }
+    CyExitCriticalSection(int_state);
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "physical.h"
+#include "prof.h"
+#include "project.h"
+#include "stopwatch.h"
+
+/*
+Tach capture. The SysTick interrupt samples the sticky status registers every
+TACH_SAMPLE_MS and timestamps every tach edge, so the fan state is always up to
+date and reading it doesn't block.
+
+A set status bit means the fan's tach was high since the last read. A pulse is
+counted on a 0 -> 1 change between samples, so a tach stuck high on a stopped
+fan doesn't count. Sampling has to be at least twice as fast as the pulses
+(3000 RPM * 2 pulses/rev = 10ms per pulse).
+*/
+#define TACH_SAMPLE_MS      1       // status register sample period
+#define TACH_SYSTICK_CB     1       // SysTick callback slot, after the stopwatch
+#define TACH_PULSES_PER_REV 2       // tach pulses per fan revolution
+#define TACH_EDGES_MIN      2       // pulses needed before a fan counts as spinning
+#define TACH_STOP_MS        100     // no pulse for this long and the fan counts as stopped (< 300 RPM)
+#define TACH_AVG_SHIFT      2       // period filter, each new period moves the average by 1/4
+
+volatile uint32_t tach_now_ms = 0;  // SysTick time
+volatile uint32_t tach_state = 0;   // 1 = fan spinning, same layout as the fan states
+volatile uint32_t tach_rising = 0;  // fans that pulsed at the last sample
+uint32_t tach_last_sample = 0;      // status registers at the previous sample
+uint32_t tach_edge_ms[FANS_PER_CELL];       // time of the last pulse
+uint32_t tach_period_us[FANS_PER_CELL];     // filtered time between pulses, 0 if unknown
+uint8_t  tach_edges[FANS_PER_CELL];         // pulses since the fan was last stopped (saturates)
+
+// Reads and combines all status registers into single uint32, clears them
+uint32_t tach_read_all(void) {
+    uint32_t Reg1 = Status_Reg_1_Read();  // tach 0-7
+    uint32_t Reg2 = Status_Reg_2_Read();  // tach 8-15
+    uint32_t Reg3 = Status_Reg_3_Read();  // tach 16-23
+    uint32_t Reg4 = Status_Reg_4_Read();  // tach 24-31
+    return (Reg1 | (Reg2 << 8) | (Reg3 << 16) | (Reg4 << 24));
+}
+
+// SysTick callback, samples the tach signals
+void tach_isr(void) {
+    if (!stopwatch_ticked) return;  // a one-shot, not a tick
+    PROF_SAMPLE(PROF_TICK_LATENCY, stopwatch_cycles() * PROF_CYCLES_PER_US / STOPWATCH_CYCLES_PER_US);
+    PROF_BEGIN(PROF_TACH_ISR);
+    uint32_t now = tach_now_ms += TACH_SAMPLE_MS;
+    uint32_t sample = tach_read_all();
+    uint32_t rising = sample & ~tach_last_sample;
+    tach_last_sample = sample;
+    tach_rising = rising;
+
+    // Fans that were spinning and haven't pulsed for too long have stopped
+    uint32_t check = tach_state & ~rising;
+    while (check) {
+        uint32_t i = __builtin_ctz(check);
+        check &= check - 1;
+        if (now - tach_edge_ms[i] >= TACH_STOP_MS) {
+            tach_state &= ~(1u << i);
+            tach_edges[i] = 0;
+            tach_period_us[i] = 0;
+        }
+    }
+
+    // Timestamp the new pulses
+    while (rising) {
+        uint32_t i = __builtin_ctz(rising);
+        rising &= rising - 1;
+        if (tach_edges[i] && now - tach_edge_ms[i] < TACH_STOP_MS) {
+            uint32_t period_us = (now - tach_edge_ms[i]) * 1000;
+            if (tach_period_us[i] == 0) tach_period_us[i] = period_us;
+            else tach_period_us[i] += ((int32_t) (period_us - tach_period_us[i])) >> TACH_AVG_SHIFT;
+        } else {
+            tach_edges[i] = 0;  // first pulse after a stop, no period yet
+            tach_period_us[i] = 0;
+        }
+        tach_edge_ms[i] = now;
+        if (tach_edges[i] < UINT8_MAX) tach_edges[i]++;
+        if (tach_edges[i] >= TACH_EDGES_MIN) tach_state |= (1u << i);
+    }
+    PROF_END(PROF_TACH_ISR);
+}
+
+// Starts sampling the tach signals from the SysTick interrupt
+void tach_init(void) {
+    tach_last_sample = tach_read_all();     // clear the sticky bits
+    CySysTickStart();
+    CySysTickSetReload(CYDEV_BCLK__SYSCLK__HZ / 1000 * TACH_SAMPLE_MS - 1);
+    CySysTickSetCallback(TACH_SYSTICK_CB, tach_isr);
+    stopwatch_init();
+}
+
+// Returns the spinning fans, 1 bit per fan
+uint32_t tach_get_state(void) {
+    return tach_state;
+}
+
+// Returns the speed of a fan in RPM, 0 if it is stopped or its speed isn't known yet
+uint32_t tach_get_rpm(uint32_t fan) {
+    uint8 int_state = CyEnterCriticalSection();
+    uint32_t period_us = tach_period_us[fan];
+    uint32_t since_ms = tach_now_ms - tach_edge_ms[fan];
+    CyExitCriticalSection(int_state);
+    if (period_us == 0) return 0;
+    // A fan that is slowing down shows it before its next pulse
+    if (since_ms * 1000 > period_us) period_us = since_ms * 1000;
+    return 60000000 / (period_us * TACH_PULSES_PER_REV);
+}
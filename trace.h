@@ -0,0 +1,121 @@
+#pragma once
+#include "project.h"
+#include "stopwatch.h"
+
+/*
+Event trace. Every node keeps its last TRACE_SIZE events in a ring in RAM:
+packets sent and received, fan state changes, validations and generation
+steps, with the Timer ms and the SysTick count (for the us within a ms).
+trace_log is self describing, dump it with the debugger (e.g. OpenOCD
+"dump_image trace.bin <&trace_log> <trace_log.bytes>") or with host/sim -T,
+and decode, profile and replay it with host/replay.
+Idle polling (reads and halos that carry no change, answered in time) isn't
+traced unless TRACE_POLLS is set, else it would fill the ring in a few ms.
+Off unless TRACE_ENABLE is set (host/project.h sets it), the ring takes
+TRACE_SIZE * 24 bytes of RAM and the events compile to nothing without it.
+*/
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE    0
+#endif
+#ifndef TRACE_SIZE
+#define TRACE_SIZE      256     // events kept per node, 24 bytes each
+#endif
+#ifndef TRACE_POLLS
+#define TRACE_POLLS     0
+#endif
+#define TRACE_MAGIC     0x46544C54  // "TLTF"
+#define TRACE_SLOW_US   1000        // round trips at least this long are traced even for idle polls
+
+// Event types, a b c and data per type
+#define TRACE_TX        1   // packet sent: a = address, b = command, c = length from the command, data = bytes after the command
+#define TRACE_RX        2   // packet received: a = sender (master) or this cell, b = command, c = length from the command,
+                            // data = bytes after the command, aux = round trip us (master)
+#define TRACE_TIMEOUT   3   // no response: a = cell, b = command, c = bytes received
+#define TRACE_FANS      4   // fan_get_state changed: data[0] = spinning fans
+#define TRACE_VAL_START 5   // fans switched: data[0] = commanded state, data[1] = fans being validated
+#define TRACE_VAL_END   6   // validation over: a = fan, b = TRACE_VAL_* reason
+#define TRACE_STEP      7   // generation: master data[0] = frame hash (conway_pack), aux = population, b = period if it repeated,
+                            // c = STUCK_ACTION; distributed cell data[0] = new state, b = 1 if it stepped (0 = halo missing,
+                            // 2 = caught up on the halos the master resent)
+#define TRACE_GRID      8   // grid the master stepped from: a = cell, data[0] = its state
+#define TRACE_WARM      9   // power up (warm.h): b = 1 if a snapshot was loaded, a = its slot, data[0] = its sequence
+
+// TRACE_VAL_END reasons
+#define TRACE_VAL_REACHED   0   // fan got to its state
+#define TRACE_VAL_EXPIRED   1   // spin up took longer than TOUT_FAN_SPINUP
+#define TRACE_VAL_STOPPED   2   // spun down
+#define TRACE_VAL_PUSHED    3   // turned by a hand while coasting
+
+typedef struct {
+    uint32_t ms;        // Timer ms, counting up
+    uint32_t tick;      // SysTick count, counting down
+    uint8_t  type;
+    uint8_t  a, b, c;
+    uint32_t data[2];
+    uint32_t aux;
+} trace_entry_t;
+
+typedef struct {
+    uint32_t magic;         // TRACE_MAGIC
+    uint32_t bytes;         // size of trace_log
+    uint32_t node;          // bus address
+    uint32_t size;          // TRACE_SIZE
+    uint32_t head;          // events written, the next goes to head % TRACE_SIZE
+    uint32_t tick_reload;   // SysTick reload, the us within a ms wrap at it
+    uint32_t cycles_per_us; // SysTick counts per us
+    uint32_t timer_period;  // Timer ms wrap at it
+    trace_entry_t entries[TRACE_SIZE];
+} trace_log_t;
+
+#if TRACE_ENABLE
+trace_log_t trace_log;
+
+// Starts the trace, once the SysTick and Timer run
+void trace_init(uint8_t node) {
+    trace_log.magic = TRACE_MAGIC;
+    trace_log.bytes = sizeof(trace_log);
+    trace_log.node = node;
+    trace_log.size = TRACE_SIZE;
+    trace_log.head = 0;
+    trace_log.tick_reload = stopwatch_reload;
+    trace_log.cycles_per_us = STOPWATCH_CYCLES_PER_US;
+    trace_log.timer_period = Timer_ReadPeriod();
+}
+
+// Adds an event, from the main loop or an interrupt
+void trace_put(uint8_t type, uint8_t a, uint8_t b, uint8_t c, uint32_t data0, uint32_t data1, uint32_t aux) {
+    uint8 int_state = CyEnterCriticalSection();
+    trace_entry_t *e = &trace_log.entries[trace_log.head % TRACE_SIZE];
+    trace_log.head++;
+    e->ms = Timer_ReadPeriod() - Timer_ReadCounter();
+    e->tick = stopwatch_reload - stopwatch_cycles();   // as if the period wasn't split (stopwatch_shot)
+    e->type = type;
+    e->a = a;
+    e->b = b;
+    e->c = c;
+    e->data[0] = data0;
+    e->data[1] = data1;
+    e->aux = aux;
+    CyExitCriticalSection(int_state);
+}
+
+// Adds a packet event, the first 8 bytes after the command are kept
+void trace_packet(uint8_t type, uint8_t addr, const uint8_t *packet, uint8_t len, uint32_t aux) {
+    uint32_t data[2] = {0, 0};
+    uint8_t n = len > 1 ? len - 1 : 0;
+    memcpy(data, &packet[1], n < sizeof(data) ? n : sizeof(data));
+    trace_put(type, addr, packet[0], len, data[0], data[1], aux);
+}
+#else
+void trace_init(uint8_t node) {
+    (void) node;
+}
+
+void trace_put(uint8_t type, uint8_t a, uint8_t b, uint8_t c, uint32_t data0, uint32_t data1, uint32_t aux) {
+    (void) type; (void) a; (void) b; (void) c; (void) data0; (void) data1; (void) aux;
+}
+
+void trace_packet(uint8_t type, uint8_t addr, const uint8_t *packet, uint8_t len, uint32_t aux) {
+    (void) type; (void) addr; (void) packet; (void) len; (void) aux;
+}
+#endif
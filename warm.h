@@ -0,0 +1,174 @@
+#pragma once
+#include "physical.h"
+#include "project.h"
+#include "stopwatch.h"
+#include "tach.h"
+#include "trace.h"
+
+/*
+Warm start. Every node keeps a snapshot of what it needs to pick up where it
+left off in the on-chip EEPROM: the master its grid, a cell its commanded fans
+and PWM config. After a reset (brown-out, watchdog) the wall comes back with
+the same pattern instead of dark, and a cell validates its way back to its
+fans in the background instead of blocking TOUT_FAN_SET first.
+The EEPROM is a ring of slots of one record each, a header row and the rows of
+the snapshot. A snapshot goes into the slot after the newest with the next
+sequence number, so every slot takes its turn (wear leveling), and an
+unchanged snapshot isn't written again. The header row is written last: a
+reset in the middle of a write leaves a record that fails its check and the
+previous one is loaded. The SPC loads and writes the rows in the background
+one at a time, warm_poll() moves on once it's idle and checks its status, a
+row that failed is written again.
+*/
+#define WARM_PERIOD_MS  30000   // snapshot this often if anything changed
+#define WARM_ROW_MS     5       // how often a row write in progress is checked
+#define WARM_BOOT_MS    (2 * TACH_STOP_MS)  // warm master: time the cells take to get back on their snapshots
+#define WARM_MAGIC      0x4D57  // "WM"
+#define WARM_ROW        CY_EEPROM_SIZEOF_ROW
+
+// SPC steps of a row
+#define WARM_SPC_IDLE   0
+#define WARM_SPC_LOAD   1   // loading the row latch
+#define WARM_SPC_WRITE  2   // writing the latch to the EEPROM row
+
+// Cell snapshot
+typedef struct {
+    uint32_t state;                     // commanded fans
+    uint32_t pulse_ms;                  // pwm_set_pulse
+    uint8_t  levels[FANS_PER_CELL];     // pwm_levels
+} warm_cell_t;
+
+// Master snapshot
+typedef struct {
+    uint32_t tiles[NUM_CELLS];          // conway_curr_frame, conway_get_tile
+} warm_master_t;
+
+#define WARM_BYTES_MAX  (sizeof(warm_master_t) > sizeof(warm_cell_t) ? sizeof(warm_master_t) : sizeof(warm_cell_t))
+#define WARM_ROWS_MAX   (1 + (WARM_BYTES_MAX + WARM_ROW - 1) / WARM_ROW)
+
+// Header row of a record
+typedef struct {
+    uint16_t magic;     // WARM_MAGIC
+    uint16_t bytes;     // snapshot size, a build with another snapshot doesn't load it
+    uint32_t seq;       // snapshots taken, the newest valid record is loaded
+    uint32_t check;     // FNV-1a over seq and the snapshot
+    uint32_t reserved;
+} warm_header_t;
+
+uint8_t  warm_record[WARM_ROWS_MAX * WARM_ROW];    // newest record, or the one being written
+uint32_t warm_bytes = 0;        // snapshot size
+uint32_t warm_rows = 0;         // rows per record, header included
+uint32_t warm_slots = 0;        // records the EEPROM holds
+uint32_t warm_slot = 0;         // slot of the newest record, or the one being written
+uint32_t warm_left = 0;         // rows of the record still to write, 0 when idle
+uint8_t  warm_spc = WARM_SPC_IDLE; // SPC step of the row in progress (SPC locked unless idle)
+uint32_t warm_timer = 0;        // counts the time since the last snapshot
+
+// Returns the check of a record
+uint32_t warm_check(uint32_t seq, const uint8_t *data, uint32_t bytes) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < 4; i++) hash = (hash ^ ((seq >> (8 * i)) & 0xFF)) * 16777619u;
+    for (uint32_t i = 0; i < bytes; i++) hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+// Reads the header of the record in `slot`, returns 1 if the record is valid
+uint8_t warm_valid(uint32_t slot, warm_header_t *header) {
+    const uint8_t *record = (const uint8_t *) (CY_EEPROM_BASE + slot * warm_rows * WARM_ROW);
+    memcpy(header, record, sizeof(warm_header_t));
+    if (header->magic != WARM_MAGIC || header->bytes != warm_bytes) return 0;
+    return header->check == warm_check(header->seq, record + WARM_ROW, warm_bytes);
+}
+
+// Finds the newest snapshot of `bytes` and copies it to `data`. Returns 1 for a warm start, 0 if there is none.
+uint8_t warm_init(void *data, uint32_t bytes) {
+    CyEEPROM_Start();
+    warm_bytes = bytes;
+    warm_rows = 1 + (bytes + WARM_ROW - 1) / WARM_ROW;
+    warm_slots = CY_EEPROM_NUMBER_ROWS / warm_rows;
+    warm_timer = stopwatch_start();
+
+    warm_header_t header, newest = {0};
+    uint8_t found = 0;
+    for (uint32_t slot = 0; slot < warm_slots; slot++) {
+        if (!warm_valid(slot, &header)) continue;
+        if (found && (int32_t) (header.seq - newest.seq) <= 0) continue;
+        newest = header;
+        warm_slot = slot;
+        found = 1;
+    }
+    if (!found) {
+        memset(warm_record, 0, sizeof(warm_record));
+        warm_slot = warm_slots - 1;     // the first snapshot goes to slot 0
+        trace_put(TRACE_WARM, 0, 0, 0, 0, 0, 0);
+        return 0;
+    }
+    memcpy(warm_record, (const uint8_t *) (CY_EEPROM_BASE + warm_slot * warm_rows * WARM_ROW), warm_rows * WARM_ROW);
+    memcpy(data, warm_record + WARM_ROW, bytes);
+    trace_put(TRACE_WARM, (uint8_t) warm_slot, 1, 0, newest.seq, 0, 0);
+    return 1;
+}
+
+// Returns 1 once a snapshot is due (WARM_PERIOD_MS since the last one and none being written)
+uint8_t warm_due(void) {
+    return warm_left == 0 && stopwatch_elapsed_ms(warm_timer) >= WARM_PERIOD_MS;
+}
+
+// Starts writing a snapshot into the next slot, does nothing if it's the same as the newest one.
+// The rows go out from warm_poll().
+void warm_save(const void *data) {
+    warm_timer = stopwatch_start();
+    if (warm_left) return;
+    warm_header_t *header = (warm_header_t *) warm_record;
+    if (header->magic == WARM_MAGIC && memcmp(warm_record + WARM_ROW, data, warm_bytes) == 0) return;
+    uint32_t seq = header->magic == WARM_MAGIC ? header->seq + 1 : 1;
+    memset(warm_record, 0, sizeof(warm_record));
+    memcpy(warm_record + WARM_ROW, data, warm_bytes);
+    header->magic = WARM_MAGIC;
+    header->bytes = (uint16_t) warm_bytes;
+    header->seq = seq;
+    header->check = warm_check(seq, warm_record + WARM_ROW, warm_bytes);
+    warm_slot = (warm_slot + 1) % warm_slots;
+    warm_left = warm_rows;
+    CySetTemp();    // the SPC writes with the die temperature
+}
+
+// Row of the record being written next, the header row last
+uint32_t warm_row(void) {
+    return (warm_rows - warm_left + 1) % warm_rows;
+}
+
+// Gives the SPC back, the row is written again unless `done`
+void warm_row_end(uint8_t done) {
+    CySpcUnlock();
+    warm_spc = WARM_SPC_IDLE;
+    if (done) warm_left--;
+}
+
+// Moves the snapshot being written along, call it often (every WARM_ROW_MS or so). Returns 1 while writing.
+uint8_t warm_poll(void) {
+    if (warm_spc != WARM_SPC_IDLE) {
+        if (!CY_SPC_IDLE) return 1;
+        uint8_t ok = CY_SPC_READ_STATUS == CY_SPC_STATUS_SUCCESS;
+        if (warm_spc == WARM_SPC_WRITE || !ok) {
+            warm_row_end(ok);
+        } else {
+            // Latch loaded, write it to the row (CySpcWriteRow takes a row number, like EEPROM_Write)
+            uint16 row = (uint16) (warm_slot * warm_rows + warm_row());
+            if (CySpcWriteRow(CY_SPC_FIRST_EE_ARRAYID, row, dieTemperature[0], dieTemperature[1]) == CYRET_STARTED) {
+                warm_spc = WARM_SPC_WRITE;
+            } else {
+                warm_row_end(0);
+            }
+        }
+        return 1;
+    }
+    if (warm_left == 0) return 0;
+    if (CySpcLock() != CYRET_SUCCESS) return 1;     // SPC in use, try again next time
+    if (CySpcLoadRow(CY_SPC_FIRST_EE_ARRAYID, warm_record + warm_row() * WARM_ROW, WARM_ROW) == CYRET_STARTED) {
+        warm_spc = WARM_SPC_LOAD;
+    } else {
+        CySpcUnlock();
+    }
+    return 1;
+}